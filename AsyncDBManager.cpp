@@ -0,0 +1,157 @@
+#include "AsyncDBManager.h"
+
+AsyncDBManager::AsyncDBManager(const DBManager &dbManager, QObject *parent)
+    : QObject(parent)
+    , worker(new QObject)
+    , workerDb(dbManager)
+{
+    // The pool gives the worker thread its own connection and closes it when the thread finishes.
+    // The thread's event loop also delivers the connection's notifications.
+    worker->moveToThread(&thread);
+    thread.setObjectName("AsyncDBManager");
+    thread.start();
+}
+
+AsyncDBManager::~AsyncDBManager()
+{
+    // Jobs still waiting in the queue are dropped
+    thread.quit();
+    thread.wait();
+    delete worker;
+}
+
+void AsyncDBManager::post(std::function<void()> job)
+{
+    QMetaObject::invokeMethod(worker, [this, job]() {
+        job();
+        resubscribe();
+    }, Qt::QueuedConnection);
+}
+
+void AsyncDBManager::listen(const QStringList &newChannels)
+{
+    post([this, newChannels]() {
+        for (const QString &channel : newChannels) {
+            if (!channels.contains(channel)) {
+                channels.append(channel);
+            }
+        }
+    });
+}
+
+void AsyncDBManager::resubscribe()
+{
+    if (channels.isEmpty()) {
+        return;
+    }
+    QSqlDriver *driver = workerDb.driver();
+    if (!driver || !driver->hasFeature(QSqlDriver::EventNotifications)) {
+        return;
+    }
+    if (driver != notifyingDriver) {
+        notifyingDriver = driver;
+        connect(driver, QOverload<const QString &, QSqlDriver::NotificationSource, const QVariant &>::of(&QSqlDriver::notification), worker,
+                [this](const QString &channel, QSqlDriver::NotificationSource source, const QVariant &payload) {
+            // Our own changes were already applied locally
+            if (source != QSqlDriver::SelfSource) {
+                emit notification(channel, payload.toString());
+            }
+        });
+    }
+    // A reopened connection has lost its subscriptions
+    for (const QString &channel : channels) {
+        workerDb.subscribe(channel);
+    }
+}
+
+DBManager &AsyncDBManager::database()
+{
+    return workerDb;
+}
+
+void AsyncDBManager::fetchDecks(QObject *context, std::function<void(const QVector<QPair<int, QString>> &)> onResult)
+{
+    run([](DBManager &db) {
+        return db.fetchDecks();
+    }, context, onResult);
+}
+
+void AsyncDBManager::fetchDecksPage(int afterId, int limit, QObject *context, std::function<void(const QVector<QPair<int, QString>> &)> onResult)
+{
+    run([afterId, limit](DBManager &db) {
+        return db.fetchDecksPage(afterId, limit);
+    }, context, onResult);
+}
+
+void AsyncDBManager::addDeck(const QString &name, QObject *context, std::function<void(int)> onResult)
+{
+    run([name](DBManager &db) {
+        return db.addDeck(name);
+    }, context, onResult);
+}
+
+void AsyncDBManager::removeDeck(int deckId, QObject *context, std::function<void(bool)> onResult)
+{
+    run([deckId](DBManager &db) {
+        return db.removeDeck(deckId);
+    }, context, onResult);
+}
+
+void AsyncDBManager::addFlashcard(int deckId, const QString &frontSide, const QString &backSide, QObject *context, std::function<void(int)> onResult)
+{
+    run([deckId, frontSide, backSide](DBManager &db) {
+        return db.addFlashcard(deckId, frontSide, backSide);
+    }, context, onResult);
+}
+
+void AsyncDBManager::fetchFlashcards(int deckId, QObject *context, std::function<void(const QVector<FlashcardRecord> &)> onResult)
+{
+    run([deckId](DBManager &db) {
+        return db.fetchFlashcardRecords(deckId);
+    }, context, onResult);
+}
+
+void AsyncDBManager::fetchCardStore(int deckId, QObject *context, std::function<void(QSharedPointer<CardStore>)> onResult)
+{
+    run([deckId](DBManager &db) {
+        return CardStore::load(db, deckId);
+    }, context, onResult);
+}
+
+void AsyncDBManager::fetchBackSide(int cardId, QObject *context, std::function<void(const QString &)> onResult)
+{
+    run([cardId](DBManager &db) {
+        return db.fetchBackSide(cardId);
+    }, context, onResult);
+}
+
+std::function<bool(qint64, qint64)> AsyncDBManager::progressReporter(QSharedPointer<QAtomicInt> cancelled, QObject *context, std::function<void(qint64, qint64)> onProgress)
+{
+    QPointer<QObject> guard(context);
+    return [this, cancelled, guard, onProgress](qint64 done, qint64 total) {
+        QMetaObject::invokeMethod(this, [guard, onProgress, done, total]() {
+            if (guard) {
+                onProgress(done, total);
+            }
+        }, Qt::QueuedConnection);
+        return !cancelled->loadRelaxed();
+    };
+}
+
+void AsyncDBManager::importCards(int deckId, const QString &path, int batchSize, QSharedPointer<QAtomicInt> cancelled, QObject *context,
+                                 std::function<void(qint64, qint64)> onProgress, std::function<void(const ImportResult &)> onResult)
+{
+    auto reportProgress = progressReporter(cancelled, context, onProgress);
+    run([deckId, path, batchSize, reportProgress](DBManager &db) {
+        return CardImporter::importFile(db, deckId, path, batchSize, reportProgress);
+    }, context, onResult);
+}
+
+void AsyncDBManager::exportDecks(const QVector<int> &deckIds, const QString &path, int fetchSize, QSharedPointer<QAtomicInt> cancelled, QObject *context,
+                                 std::function<void(qint64, qint64)> onProgress, std::function<void(const ExportResult &)> onResult)
+{
+    auto reportProgress = progressReporter(cancelled, context, onProgress);
+    run([deckIds, path, fetchSize, reportProgress](DBManager &db) {
+        return CardExporter::exportDecks(db, deckIds, path, fetchSize, reportProgress);
+    }, context, onResult);
+}
@@ -0,0 +1,94 @@
+#ifndef ASYNCDBMANAGER_H
+#define ASYNCDBMANAGER_H
+
+#include <QObject>
+#include <QMetaObject>
+#include <QPair>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <functional>
+#include <utility>
+#include "DBManager.h"
+#include "CardStore.h"
+#include "CardImporter.h"
+#include "CardExporter.h"
+#include <QAtomicInt>
+
+// Runs DBManager calls on a worker thread that owns its own connection.
+// Rows are materialized into value types on that thread and the result is
+// handed to a callback on the GUI thread. Callbacks are tied to a context
+// object and dropped if it was destroyed in the meantime. Jobs run one at a
+// time in the order they were submitted.
+class AsyncDBManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Shares dbManager's connection pool, the worker thread checks out its own connection
+    AsyncDBManager(const DBManager &dbManager, QObject *parent = nullptr);
+    ~AsyncDBManager();
+
+    void fetchDecks(QObject *context, std::function<void(const QVector<QPair<int, QString>> &decks)> onResult);
+    void fetchDecksPage(int afterId, int limit, QObject *context, std::function<void(const QVector<QPair<int, QString>> &decks)> onResult);
+    // deckId is -1 if the insert failed
+    void addDeck(const QString &name, QObject *context, std::function<void(int deckId)> onResult);
+    void removeDeck(int deckId, QObject *context, std::function<void(bool ok)> onResult);
+    // cardId is -1 if the insert failed
+    void addFlashcard(int deckId, const QString &frontSide, const QString &backSide, QObject *context, std::function<void(int cardId)> onResult);
+    void fetchFlashcards(int deckId, QObject *context, std::function<void(const QVector<FlashcardRecord> &flashcards)> onResult);
+    // The store is built on the worker and handed over without copying its cards, null on failure
+    void fetchCardStore(int deckId, QObject *context, std::function<void(QSharedPointer<CardStore> store)> onResult);
+    // backSide is null if the card does not exist
+    void fetchBackSide(int cardId, QObject *context, std::function<void(const QString &backSide)> onResult);
+
+    // Imports a CSV, TSV or Anki text export into the deck. onProgress is called on the GUI thread
+    // after every batch, setting cancelled to 1 rolls the import back at the next batch.
+    void importCards(int deckId, const QString &path, int batchSize, QSharedPointer<QAtomicInt> cancelled, QObject *context,
+                     std::function<void(qint64 done, qint64 total)> onProgress, std::function<void(const ImportResult &result)> onResult);
+
+    // Exports the decks, every deck if deckIds is empty, progress and cancelling work as for importCards
+    void exportDecks(const QVector<int> &deckIds, const QString &path, int fetchSize, QSharedPointer<QAtomicInt> cancelled, QObject *context,
+                     std::function<void(qint64 done, qint64 total)> onProgress, std::function<void(const ExportResult &result)> onResult);
+
+    // LISTEN on the worker's connection, notifications sent by other connections arrive as notification()
+    void listen(const QStringList &channels);
+
+    // Runs work(DBManager &) on the worker thread and passes its return value to onResult.
+    // The return value must be a value type, a QSqlQuery can't leave the worker thread.
+    template <typename Work, typename Callback>
+    void run(Work work, QObject *context, Callback onResult)
+    {
+        QPointer<QObject> guard(context);
+        post([this, work, guard, onResult]() mutable {
+            auto result = work(database());
+            QMetaObject::invokeMethod(this, [guard, onResult, result]() mutable {
+                if (guard) {
+                    onResult(result);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+
+signals:
+    void notification(const QString &channel, const QString &payload);
+
+private:
+    void post(std::function<void()> job);
+    // Only called on the worker thread
+    DBManager &database();
+    // Subscribes again if the connection was reopened, only called on the worker thread
+    void resubscribe();
+    // Progress callback for a long job, posts to onProgress on the GUI thread and returns false once cancelled
+    std::function<bool(qint64, qint64)> progressReporter(QSharedPointer<QAtomicInt> cancelled, QObject *context, std::function<void(qint64, qint64)> onProgress);
+
+    QThread thread;
+    QObject *worker;
+    DBManager workerDb;
+    QStringList channels;
+    QSqlDriver *notifyingDriver = nullptr;
+};
+
+#endif // ASYNCDBMANAGER_H
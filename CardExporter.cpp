@@ -0,0 +1,217 @@
+#include "CardExporter.h"
+
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStringList>
+
+static QByteArray csvField(const QString &value)
+{
+    QString quoted = value;
+    quoted.replace('"', "\"\"");
+    return ('"' + quoted + '"').toUtf8();
+}
+
+static QByteArray csvRow(const QStringList &fields)
+{
+    QByteArray row;
+    for (int i = 0; i < fields.size(); ++i)
+    {
+        if (i > 0)
+        {
+            row += ',';
+        }
+        row += csvField(fields.at(i));
+    }
+    return row + '\n';
+}
+
+static QByteArray jsonLine(const QJsonObject &object)
+{
+    return QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+}
+
+CardExporter::Format CardExporter::formatFor(const QString &path)
+{
+    return QFileInfo(path).suffix().toLower() == "jsonl" ? JsonLines : Csv;
+}
+
+ExportResult CardExporter::exportDecks(DBManager &dbManager, const QVector<int> &deckIds, const QString &path, int fetchSize, std::function<bool(qint64, qint64)> onProgress)
+{
+    ExportResult result;
+    const Format format = formatFor(path);
+    // Written to a temporary file that only replaces path once the export is complete
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        result.error = file.errorString();
+        return result;
+    }
+
+    // DECLARE takes no parameters, the ids are integers formatted here
+    QString filter;
+    if (!deckIds.isEmpty())
+    {
+        QStringList ids;
+        for (int deckId : deckIds)
+        {
+            ids.append(QString::number(deckId));
+        }
+        filter = " WHERE f.deck_id IN (" + ids.join(',') + ")";
+    }
+    PooledQuery count = dbManager.executeQuery("SELECT count(*) FROM flashcards f" + filter);
+    const qint64 total = count.next() ? count.value(0).toLongLong() : 0;
+
+    // A cursor only lives inside a transaction, on SQLite the transaction keeps one snapshot for the whole export
+    const bool sqlite = dbManager.isSqlite();
+    if (!dbManager.beginTransaction())
+    {
+        file.cancelWriting();
+        result.error = "Could not start a transaction.";
+        return result;
+    }
+    auto fail = [&](const QString &error) {
+        dbManager.rollbackTransaction();
+        file.cancelWriting();
+        result.exported = 0;
+        result.error = error;
+        return result;
+    };
+    const QString from = " FROM flashcards f JOIN decks d ON d.id = f.deck_id LEFT JOIN review_state r ON r.card_id = f.id" + filter + " ORDER BY f.deck_id, f.id";
+    // SQLite hands out the rows of a plain SELECT one step at a time, so it needs no cursor to stay within memory
+    PooledQuery cards = dbManager.executeQuery(sqlite
+        ? "SELECT f.deck_id, d.name, f.frontSide, f.backSide, r.due, r.interval_days, r.ease, r.repetitions, r.lapses, "
+          "(SELECT json_group_array(json_object('prompt_hash', e.prompt_hash, 'model', e.model, 'card_hash', e.card_hash, 'sentence', e.sentence)) "
+          "FROM exercise_cache e WHERE e.card_id = f.id)" + from
+        : "DECLARE export_cards NO SCROLL CURSOR FOR "
+          "SELECT f.deck_id, d.name, f.frontSide, f.backSide, r.due, r.interval_days, r.ease, r.repetitions, r.lapses, "
+          "(SELECT json_agg(json_build_object('prompt_hash', e.prompt_hash, 'model', e.model, 'card_hash', e.card_hash, 'sentence', e.sentence) ORDER BY e.id) "
+          "FROM exercise_cache e WHERE e.card_id = f.id)::text" + from);
+    if (cards.lastError().type() != QSqlError::NoError)
+    {
+        return fail("Could not read the decks.");
+    }
+
+    if (format == JsonLines)
+    {
+        QJsonObject header;
+        header["type"] = "header";
+        header["format"] = "flashcards";
+        header["version"] = 1;
+        file.write(jsonLine(header));
+    }
+    else
+    {
+        file.write(csvRow(QStringList() << "front" << "back" << "deck" << "due" << "interval_days" << "ease" << "repetitions" << "lapses"));
+    }
+
+    int currentDeck = -1;
+    auto writeRow = [&](const QSqlQuery &page) {
+        const int deckId = page.value(0).toInt();
+        const QString deckName = page.value(1).toString();
+        const bool hasReview = !page.value(4).isNull();
+        const QString due = hasReview ? DBManager::toDateTime(page.value(4)).toUTC().toString(Qt::ISODateWithMs) : QString();
+        if (format == JsonLines)
+        {
+            if (deckId != currentDeck)
+            {
+                QJsonObject deck;
+                deck["type"] = "deck";
+                deck["id"] = deckId;
+                deck["name"] = deckName;
+                file.write(jsonLine(deck));
+            }
+            QJsonObject card;
+            card["type"] = "card";
+            card["deck"] = deckId;
+            card["front"] = page.value(2).toString();
+            card["back"] = page.value(3).toString();
+            if (hasReview)
+            {
+                QJsonObject review;
+                review["due"] = due;
+                review["interval_days"] = page.value(5).toDouble();
+                review["ease"] = page.value(6).toDouble();
+                review["repetitions"] = page.value(7).toInt();
+                review["lapses"] = page.value(8).toInt();
+                card["review"] = review;
+            }
+            const QJsonArray exercises = QJsonDocument::fromJson(page.value(9).toString().toUtf8()).array();
+            if (!exercises.isEmpty())
+            {
+                card["exercises"] = exercises;
+            }
+            file.write(jsonLine(card));
+        }
+        else
+        {
+            file.write(csvRow(QStringList() << page.value(2).toString() << page.value(3).toString() << deckName << due
+                                            << (hasReview ? page.value(5).toString() : QString())
+                                            << (hasReview ? page.value(6).toString() : QString())
+                                            << (hasReview ? page.value(7).toString() : QString())
+                                            << (hasReview ? page.value(8).toString() : QString())));
+        }
+        currentDeck = deckId;
+    };
+
+    const int pageSize = qMax(1, fetchSize);
+    if (sqlite)
+    {
+        while (cards.next())
+        {
+            writeRow(cards);
+            if (++result.exported % pageSize == 0 && onProgress && !onProgress(result.exported, total))
+            {
+                return fail("Export cancelled.");
+            }
+        }
+        if (cards.lastError().type() != QSqlError::NoError)
+        {
+            return fail("Could not read the decks.");
+        }
+        if (onProgress)
+        {
+            onProgress(result.exported, total);
+        }
+    }
+    else
+    {
+        const QString fetch = QString("FETCH %1 FROM export_cards").arg(pageSize);
+        for (;;)
+        {
+            PooledQuery page = dbManager.executeQuery(fetch);
+            if (page.lastError().type() != QSqlError::NoError)
+            {
+                return fail("Could not read the decks.");
+            }
+            int rows = 0;
+            while (page.next())
+            {
+                rows++;
+                writeRow(page);
+            }
+            if (rows == 0)
+            {
+                break;
+            }
+            result.exported += rows;
+            if (onProgress && !onProgress(result.exported, total))
+            {
+                return fail("Export cancelled.");
+            }
+        }
+        dbManager.executeQuery("CLOSE export_cards");
+    }
+
+    dbManager.commitTransaction();
+    if (!file.commit())
+    {
+        result.exported = 0;
+        result.error = file.errorString();
+        return result;
+    }
+    result.ok = true;
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef CARDEXPORTER_H
+#define CARDEXPORTER_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "DBManager.h"
+
+struct ExportResult
+{
+    bool ok = false;
+    int exported = 0;
+    QString error;
+};
+
+// Writes decks to a file that CardImporter reads back. Rows are read through
+// a server-side cursor a page at a time (SQLite steps a plain SELECT) and
+// written as they arrive, so the memory used doesn't depend on the deck size. CSV carries the cards and
+// their review state; JSON lines (.jsonl) also carries the deck names and
+// the cached exercise sentences.
+class CardExporter
+{
+public:
+    enum Format { Csv, JsonLines };
+
+    // .jsonl is JSON lines, anything else CSV
+    static Format formatFor(const QString &path);
+    // deckIds empty exports every deck. onProgress gets the cards written and the total,
+    // returning false cancels the export and leaves no file behind.
+    static ExportResult exportDecks(DBManager &dbManager, const QVector<int> &deckIds, const QString &path, int fetchSize, std::function<bool(qint64 done, qint64 total)> onProgress);
+};
+
+#endif // CARDEXPORTER_H
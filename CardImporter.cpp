@@ -0,0 +1,467 @@
+#include "CardImporter.h"
+
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+
+CardImportReader::CardImportReader(const QString &path)
+    : file(path) {}
+
+bool CardImportReader::open()
+{
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    stream.setDevice(&file);
+    const QString suffix = QFileInfo(file.fileName()).suffix().toLower();
+    separator = suffix == "csv" ? QChar(',') : QChar('\t');
+    json = suffix == "jsonl";
+    if (!json)
+    {
+        readHeader();
+    }
+    return true;
+}
+
+QString CardImportReader::errorString() const
+{
+    return file.errorString();
+}
+
+void CardImportReader::readHeader()
+{
+    // Anki exports start with lines such as "#separator:tab" and "#html:true"
+    while (!stream.atEnd())
+    {
+        const QString line = stream.readLine();
+        if (!line.startsWith('#'))
+        {
+            pendingLine = line;
+            hasPendingLine = true;
+            return;
+        }
+        const QString setting = line.mid(1).section(':', 0, 0).trimmed().toLower();
+        const QString value = line.section(':', 1).trimmed().toLower();
+        if (setting == "separator")
+        {
+            if (value == "tab") separator = '\t';
+            else if (value == "comma") separator = ',';
+            else if (value == "semicolon") separator = ';';
+            else if (value == "pipe") separator = '|';
+            else if (value == "space") separator = ' ';
+            else if (value.size() == 1) separator = value.at(0);
+        }
+        else if (setting == "html")
+        {
+            html = value == "true";
+        }
+    }
+}
+
+bool CardImportReader::readRecord(QStringList &fields)
+{
+    QString line;
+    if (hasPendingLine)
+    {
+        line = pendingLine;
+        hasPendingLine = false;
+    }
+    else if (stream.atEnd())
+    {
+        return false;
+    }
+    else
+    {
+        line = stream.readLine();
+    }
+
+    // Quoted fields may contain separators, doubled quotes and line breaks
+    fields.clear();
+    QString field;
+    bool quoted = false;
+    bool wasQuoted = false;
+    for (;;)
+    {
+        for (int i = 0; i < line.size(); ++i)
+        {
+            const QChar c = line.at(i);
+            if (quoted)
+            {
+                if (c != '"')
+                {
+                    field += c;
+                }
+                else if (i + 1 < line.size() && line.at(i + 1) == '"')
+                {
+                    field += '"';
+                    ++i;
+                }
+                else
+                {
+                    quoted = false;
+                }
+            }
+            else if (c == '"' && field.isEmpty() && !wasQuoted)
+            {
+                quoted = true;
+                wasQuoted = true;
+            }
+            else if (c == separator)
+            {
+                fields.append(field);
+                field.clear();
+                wasQuoted = false;
+            }
+            else
+            {
+                field += c;
+            }
+        }
+        if (!quoted || stream.atEnd())
+        {
+            break;
+        }
+        field += '\n';
+        line = stream.readLine();
+    }
+    fields.append(field);
+    return true;
+}
+
+bool CardImportReader::next(ImportedCard &card, bool &valid)
+{
+    if (json)
+    {
+        return nextJson(card, valid);
+    }
+    QStringList fields;
+    while (readRecord(fields))
+    {
+        if (fields.size() == 1 && fields.first().trimmed().isEmpty())
+        {
+            continue;
+        }
+        if (firstRecord)
+        {
+            firstRecord = false;
+            // A header row such as "front,back" names the columns
+            const QString first = fields.first().trimmed();
+            if (first.compare("front", Qt::CaseInsensitive) == 0 || first.compare("question", Qt::CaseInsensitive) == 0)
+            {
+                for (int i = 0; i < fields.size(); ++i)
+                {
+                    columns.insert(fields.at(i).trimmed().toLower(), i);
+                }
+                continue;
+            }
+        }
+        card = ImportedCard();
+        card.frontSide = fields.value(0);
+        card.backSide = fields.value(1);
+        if (html)
+        {
+            card.frontSide = stripHtml(card.frontSide);
+            card.backSide = stripHtml(card.backSide);
+        }
+        card.frontSide = card.frontSide.trimmed();
+        card.backSide = card.backSide.trimmed();
+        if (columns.contains("deck"))
+        {
+            card.deckName = fields.value(columns.value("deck")).trimmed();
+            card.deckKey = card.deckName;
+        }
+        if (columns.contains("due"))
+        {
+            card.review.due = QDateTime::fromString(fields.value(columns.value("due")), Qt::ISODateWithMs);
+            card.review.intervalDays = fields.value(columns.value("interval_days", -1)).toDouble();
+            card.review.ease = fields.value(columns.value("ease", -1), "2.5").toDouble();
+            card.review.repetitions = fields.value(columns.value("repetitions", -1)).toInt();
+            card.review.lapses = fields.value(columns.value("lapses", -1)).toInt();
+            card.hasReview = card.review.due.isValid();
+        }
+        valid = !card.frontSide.isEmpty() && !card.backSide.isEmpty();
+        return true;
+    }
+    return false;
+}
+
+bool CardImportReader::nextJson(ImportedCard &card, bool &valid)
+{
+    while (!stream.atEnd())
+    {
+        const QJsonObject line = QJsonDocument::fromJson(stream.readLine().toUtf8()).object();
+        const QString type = line.value("type").toString();
+        // A deck line comes before the deck's cards
+        if (type == "deck")
+        {
+            deckNames.insert(line.value("id").toInt(), line.value("name").toString());
+            continue;
+        }
+        if (type != "card")
+        {
+            continue;
+        }
+        card = ImportedCard();
+        card.frontSide = line.value("front").toString().trimmed();
+        card.backSide = line.value("back").toString().trimmed();
+        if (line.contains("deck"))
+        {
+            const int deck = line.value("deck").toInt();
+            card.deckKey = QString::number(deck);
+            card.deckName = deckNames.value(deck);
+        }
+        const QJsonObject review = line.value("review").toObject();
+        if (!review.isEmpty())
+        {
+            card.review.due = QDateTime::fromString(review.value("due").toString(), Qt::ISODateWithMs);
+            card.review.intervalDays = review.value("interval_days").toDouble();
+            card.review.ease = review.value("ease").toDouble(2.5);
+            card.review.repetitions = review.value("repetitions").toInt();
+            card.review.lapses = review.value("lapses").toInt();
+            card.hasReview = card.review.due.isValid();
+        }
+        for (const QJsonValue &value : line.value("exercises").toArray())
+        {
+            const QJsonObject exercise = value.toObject();
+            CachedExercise cached;
+            cached.promptHash = exercise.value("prompt_hash").toString();
+            cached.model = exercise.value("model").toString();
+            cached.cardHash = exercise.value("card_hash").toString();
+            cached.sentence = exercise.value("sentence").toString();
+            card.exercises.append(cached);
+        }
+        valid = !card.frontSide.isEmpty() && !card.backSide.isEmpty();
+        return true;
+    }
+    return false;
+}
+
+qint64 CardImportReader::position() const
+{
+    // The stream reads ahead in blocks, close enough for a progress bar
+    return file.pos();
+}
+
+qint64 CardImportReader::size() const
+{
+    return file.size();
+}
+
+QString CardImportReader::stripHtml(const QString &text)
+{
+    static const QRegularExpression lineBreak("<br\\s*/?>|</div>|</p>", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression tag("<[^>]*>");
+    QString plain = text;
+    plain.replace(lineBreak, "\n");
+    plain.remove(tag);
+    plain.replace("&nbsp;", " ");
+    plain.replace("&lt;", "<");
+    plain.replace("&gt;", ">");
+    plain.replace("&quot;", "\"");
+    plain.replace("&#39;", "'");
+    plain.replace("&amp;", "&");
+    return plain;
+}
+
+QString CardImporter::normalizedKey(const QString &frontSide)
+{
+    // "Café!", "cafe" and " CAFE " are the same card
+    const QString decomposed = frontSide.normalized(QString::NormalizationForm_KD);
+    QString key;
+    key.reserve(decomposed.size());
+    for (const QChar c : decomposed)
+    {
+        if (c.isLetterOrNumber())
+        {
+            key += c.toCaseFolded();
+        }
+    }
+    // Fronts made only of punctuation are compared as they are
+    return key.isEmpty() ? frontSide.trimmed() : key;
+}
+
+ImportResult CardImporter::importFile(DBManager &dbManager, int deckId, const QString &path, int batchSize, std::function<bool(qint64, qint64)> onProgress)
+{
+    // Three bound parameters per row, Postgres takes at most 65535 per statement and SQLite 32766
+    batchSize = qBound(1, batchSize, (dbManager.isSqlite() ? 32766 : 65535) / 3);
+    ImportResult result;
+    CardImportReader reader(path);
+    if (!reader.open())
+    {
+        result.error = reader.errorString();
+        return result;
+    }
+
+    // Normalized fronts per deck the file goes into, duplicates are only looked for within a deck
+    QHash<int, QSet<QString>> seen;
+    PooledQuery existing = dbManager.executeQuery("SELECT frontSide FROM flashcards WHERE deck_id = ?", QVariantList() << deckId);
+    while (existing.next())
+    {
+        seen[deckId].insert(normalizedKey(existing.value(0).toString()));
+    }
+
+    // All or nothing, and the per-row change notifications are replaced by a single one per deck
+    if (!dbManager.beginTransaction())
+    {
+        result.error = "Could not start a transaction.";
+        return result;
+    }
+    // The embedded database has no change notifications to suppress
+    if (!dbManager.isSqlite())
+    {
+        dbManager.executeQuery("SET LOCAL flashcards.bulk_import = 'on'");
+    }
+
+    // Exported decks by their key in the file, the first one is the chosen deck
+    QHash<QString, int> targets;
+    QVector<int> targetDecks = {deckId};
+    int batchDeck = deckId;
+    QVector<ImportedCard> batch;
+    batch.reserve(batchSize);
+    auto fail = [&](const QString &error) {
+        dbManager.rollbackTransaction();
+        result.imported = 0;
+        result.createdDecks.clear();
+        result.error = error;
+        return result;
+    };
+    auto flush = [&]() {
+        if (batch.isEmpty())
+        {
+            return true;
+        }
+        QVector<FlashcardRecord> cards;
+        cards.reserve(batch.size());
+        for (const ImportedCard &imported : batch)
+        {
+            FlashcardRecord card;
+            card.frontSide = imported.frontSide;
+            card.backSide = imported.backSide;
+            cards.append(card);
+        }
+        QVector<int> ids;
+        if (!dbManager.insertFlashcards(batchDeck, cards, &ids) || ids.size() != batch.size())
+        {
+            return false;
+        }
+        // Exported review state and sentences follow their card to its new id
+        QVector<ReviewState> reviews;
+        QVector<CachedExercise> exercises;
+        for (int i = 0; i < batch.size(); ++i)
+        {
+            if (batch.at(i).hasReview)
+            {
+                ReviewState review = batch.at(i).review;
+                review.cardId = ids.at(i);
+                reviews.append(review);
+            }
+            for (CachedExercise exercise : batch.at(i).exercises)
+            {
+                exercise.cardId = ids.at(i);
+                exercises.append(exercise);
+            }
+        }
+        if (!dbManager.updateReviewStates(reviews) || !dbManager.insertCachedExercises(exercises))
+        {
+            return false;
+        }
+        result.imported += batch.size();
+        batch.clear();
+        return true;
+    };
+    // The deck a card of the file goes into, -1 if a new deck could not be added
+    auto targetOf = [&](const ImportedCard &card) {
+        if (card.deckKey.isEmpty())
+        {
+            return deckId;
+        }
+        if (targets.contains(card.deckKey))
+        {
+            return targets.value(card.deckKey);
+        }
+        int target = deckId;
+        if (!targets.isEmpty())
+        {
+            const QString name = card.deckName.isEmpty() ? QFileInfo(path).completeBaseName() : card.deckName;
+            target = dbManager.addDeck(name);
+            if (target < 0)
+            {
+                return -1;
+            }
+            result.createdDecks.append(qMakePair(target, name));
+            targetDecks.append(target);
+        }
+        targets.insert(card.deckKey, target);
+        return target;
+    };
+
+    ImportedCard card;
+    bool valid = false;
+    while (reader.next(card, valid))
+    {
+        if (!valid)
+        {
+            result.invalid++;
+            continue;
+        }
+        const int target = targetOf(card);
+        if (target < 0)
+        {
+            return fail("Failed to add a deck.");
+        }
+        if (target != batchDeck)
+        {
+            if (!flush())
+            {
+                return fail("Failed to insert flashcards.");
+            }
+            batchDeck = target;
+        }
+        const QString key = normalizedKey(card.frontSide);
+        QSet<QString> &deckSeen = seen[target];
+        if (deckSeen.contains(key))
+        {
+            result.duplicates++;
+            continue;
+        }
+        deckSeen.insert(key);
+        batch.append(card);
+        if (batch.size() < batchSize)
+        {
+            continue;
+        }
+        if (!flush())
+        {
+            return fail("Failed to insert flashcards.");
+        }
+        if (onProgress && !onProgress(reader.position(), reader.size()))
+        {
+            return fail("Import cancelled.");
+        }
+    }
+    if (!flush())
+    {
+        return fail("Failed to insert flashcards.");
+    }
+
+    if (!dbManager.isSqlite())
+    {
+        for (int target : targetDecks)
+        {
+            dbManager.executeQuery("SELECT pg_notify('flashcard_changes', json_build_object('op', 'IMPORT', 'deck_id', ?)::text)", QVariantList() << target);
+        }
+    }
+    if (!dbManager.commitTransaction())
+    {
+        return fail("Failed to commit the import.");
+    }
+    if (onProgress)
+    {
+        onProgress(reader.size(), reader.size());
+    }
+    result.ok = true;
+    return result;
+}
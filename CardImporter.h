@@ -0,0 +1,93 @@
+#ifndef CARDIMPORTER_H
+#define CARDIMPORTER_H
+
+#include <QChar>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <functional>
+#include "DBManager.h"
+
+struct ImportResult
+{
+    bool ok = false;
+    int imported = 0;
+    // Cards already in the deck or earlier in the file, compared after normalizing the front side
+    int duplicates = 0;
+    // Rows without both a front and a back side
+    int invalid = 0;
+    // Decks recreated from an export of several decks, id and name
+    QVector<QPair<int, QString>> createdDecks;
+    QString error;
+};
+
+// One card read from a file, with the review state and sentences of an export
+struct ImportedCard
+{
+    QString frontSide;
+    QString backSide;
+    // The exported deck the card came from, empty when the file doesn't say
+    QString deckKey;
+    QString deckName;
+    bool hasReview = false;
+    ReviewState review;
+    QVector<CachedExercise> exercises;
+};
+
+// Reads cards from CSV, TSV, Anki "Notes in Plain Text" exports and our own
+// JSON lines exports one record at a time, so the file is never held in
+// memory. The format is chosen from the extension: .csv is comma separated,
+// .tsv and .txt tab separated, .jsonl one JSON object per line. Anki's
+// #separator and #html header lines are honoured, and a CSV header row
+// naming the review columns restores the review state.
+class CardImportReader
+{
+public:
+    explicit CardImportReader(const QString &path);
+    bool open();
+    QString errorString() const;
+    // false at the end of the file
+    bool next(ImportedCard &card, bool &valid);
+    qint64 position() const;
+    qint64 size() const;
+
+private:
+    bool readRecord(QStringList &fields);
+    bool nextJson(ImportedCard &card, bool &valid);
+    void readHeader();
+    static QString stripHtml(const QString &text);
+
+    QFile file;
+    QTextStream stream;
+    QChar separator = ',';
+    bool html = false;
+    bool json = false;
+    // Column of each named field when the file has a header row
+    QHash<QString, int> columns;
+    // Names from the deck lines of a JSON lines export
+    QHash<int, QString> deckNames;
+    bool firstRecord = true;
+    QString pendingLine;
+    bool hasPendingLine = false;
+};
+
+// Loads a file into a deck in one transaction with multi-row inserts.
+// Near-duplicates are skipped: fronts are compared case, accent, markup
+// and punctuation insensitively against the deck and the rest of the file.
+// An export of several decks keeps them apart: the cards of its first deck
+// go into the chosen deck and every further deck is added under its
+// exported name.
+class CardImporter
+{
+public:
+    // onProgress gets the bytes read so far and the file size, returning false cancels the import.
+    // batchSize is capped so that one INSERT stays within the database's bound-parameter limit.
+    static ImportResult importFile(DBManager &dbManager, int deckId, const QString &path, int batchSize, std::function<bool(qint64 done, qint64 total)> onProgress);
+    static QString normalizedKey(const QString &frontSide);
+};
+
+#endif // CARDIMPORTER_H
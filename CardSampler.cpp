@@ -0,0 +1,130 @@
+#include "CardSampler.h"
+
+#include <QHash>
+#include <QRandomGenerator>
+
+// Ids read in the first page after a draw's starting point and at most in one page.
+// Pages grow as they turn up cards drawn before, late in a round.
+static const int firstPage = 32;
+static const int maxPage = 1000;
+
+CardSampler::CardSampler(int deckId, bool withoutReplacement)
+    : deckId(deckId), withoutReplacement(withoutReplacement) {}
+
+bool CardSampler::loadRange(DBManager &dbManager)
+{
+    if (rangeStale.fetchAndStoreRelaxed(0))
+    {
+        const QPair<int, int> range = dbManager.fetchFlashcardIdRange(deckId);
+        minId = range.first;
+        maxId = range.second;
+    }
+    return minId != -1;
+}
+
+int CardSampler::drawId(DBManager &dbManager)
+{
+    const int pivot = QRandomGenerator::global()->bounded(minId, maxId + 1);
+    int after = pivot - 1;
+    int page = firstPage;
+    bool wrapped = false;
+    while (true)
+    {
+        const QVector<int> ids = dbManager.fetchFlashcardIds(deckId, after, page);
+        for (int id : ids)
+        {
+            if (wrapped && id >= pivot)
+            {
+                // Back where the draw started, every card was drawn this round
+                return -1;
+            }
+            if (!visited.contains(id))
+            {
+                return id;
+            }
+        }
+        if (ids.size() < page)
+        {
+            if (wrapped)
+            {
+                return -1;
+            }
+            // Past the deck's last card, go on from its first
+            wrapped = true;
+            after = minId - 1;
+        }
+        else
+        {
+            after = ids.last();
+        }
+        page = qMin(page * 2, maxPage);
+    }
+}
+
+QVector<FlashcardRecord> CardSampler::sampleRound(DBManager &dbManager, int count)
+{
+    QVector<int> ids;
+    while (ids.size() < count)
+    {
+        const int id = drawId(dbManager);
+        if (id == -1)
+        {
+            break;
+        }
+        visited.insert(id);
+        ids.append(id);
+    }
+    if (ids.isEmpty())
+    {
+        return QVector<FlashcardRecord>();
+    }
+    QHash<int, FlashcardRecord> byId;
+    for (const FlashcardRecord &card : dbManager.fetchFlashcardsById(deckId, ids))
+    {
+        byId.insert(card.id, card);
+    }
+    // In the order drawn, the query returns them in id order; cards deleted in between are left out
+    QVector<FlashcardRecord> cards;
+    for (int id : ids)
+    {
+        if (byId.contains(id))
+        {
+            cards.append(byId.value(id));
+        }
+    }
+    return cards;
+}
+
+QVector<FlashcardRecord> CardSampler::sample(DBManager &dbManager, int count)
+{
+    if (resetPending.fetchAndStoreRelaxed(0))
+    {
+        visited.clear();
+    }
+    if (count <= 0 || !loadRange(dbManager))
+    {
+        return QVector<FlashcardRecord>();
+    }
+    if (!withoutReplacement)
+    {
+        return dbManager.sampleFlashcards(deckId, count, minId, maxId);
+    }
+    QVector<FlashcardRecord> cards = sampleRound(dbManager, count);
+    if (cards.isEmpty())
+    {
+        // Every card was drawn this round, start the next one
+        visited.clear();
+        cards = sampleRound(dbManager, count);
+    }
+    return cards;
+}
+
+void CardSampler::reset()
+{
+    resetPending.storeRelaxed(1);
+}
+
+void CardSampler::invalidate()
+{
+    rangeStale.storeRelaxed(1);
+}
@@ -0,0 +1,46 @@
+#ifndef CARDSAMPLER_H
+#define CARDSAMPLER_H
+
+#include <QAtomicInt>
+#include <QSet>
+#include <QVector>
+#include "DBManager.h"
+
+// Draws random cards of one deck straight from the database, a few at a
+// time, instead of loading the deck to pick from it. In without-replacement
+// mode a card is not drawn again until every card of the deck was drawn
+// once in the session; then the next round starts. Each draw picks a random
+// id in the deck's range and reads the deck's own ids from there on the
+// (deck_id, id) index until one not drawn this round turns up, so ids of
+// other decks are never probed. Sampling runs on the database worker with the
+// worker's DBManager, one call at a time; reset() and invalidate() may be
+// called from any thread and apply to the next sample.
+class CardSampler
+{
+public:
+    CardSampler(int deckId, bool withoutReplacement = true);
+
+    // Up to count distinct cards, fewer when the round is almost used up, none if the deck is empty
+    QVector<FlashcardRecord> sample(DBManager &dbManager, int count);
+    // Starts a new session, every card can be drawn again
+    void reset();
+    // Cards were added or removed, the id range is read again on the next sample
+    void invalidate();
+
+private:
+    bool loadRange(DBManager &dbManager);
+    // Id of a card not drawn this round, -1 once the round has drawn every card of the deck
+    int drawId(DBManager &dbManager);
+    QVector<FlashcardRecord> sampleRound(DBManager &dbManager, int count);
+
+    int deckId;
+    bool withoutReplacement;
+    QAtomicInt resetPending;
+    QAtomicInt rangeStale{1};
+    int minId = -1;
+    int maxId = -1;
+    // Cards drawn this round, ids deleted since then are never read again and don't matter
+    QSet<int> visited;
+};
+
+#endif // CARDSAMPLER_H
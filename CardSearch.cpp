@@ -0,0 +1,464 @@
+#include "CardSearch.h"
+
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QSet>
+#include <algorithm>
+#include <limits>
+
+// Shorter last words are matched whole, a one-letter prefix would match most of the vocabulary
+static const int minPrefixLength = 2;
+// A search the index can't narrow down is given up instead of holding up the next keystroke
+static const int statementTimeoutMs = 1000;
+
+QStringList CardSearchIndex::tokenize(const QString &text)
+{
+    // "Café" and "cafe" are the same word, accents are dropped after decomposing
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QStringList words;
+    QString word;
+    for (const QChar c : decomposed)
+    {
+        if (c.isLetterOrNumber())
+        {
+            word += c.toCaseFolded();
+        }
+        else if (c.category() == QChar::Mark_NonSpacing || c.category() == QChar::Mark_SpacingCombining || c.category() == QChar::Mark_Enclosing)
+        {
+            continue;
+        }
+        else if (!word.isEmpty())
+        {
+            words.append(word);
+            word.clear();
+        }
+    }
+    if (!word.isEmpty())
+    {
+        words.append(word);
+    }
+    return words;
+}
+
+static void addPosting(QVector<int> &ids, int cardId)
+{
+    // Cards mostly arrive in id order, so this is usually an append
+    if (ids.isEmpty() || ids.last() < cardId)
+    {
+        ids.append(cardId);
+        return;
+    }
+    auto it = std::lower_bound(ids.begin(), ids.end(), cardId);
+    if (it == ids.end() || *it != cardId)
+    {
+        ids.insert(it, cardId);
+    }
+}
+
+static void removePosting(std::map<QString, QVector<int>> &postings, const QString &word, int cardId)
+{
+    auto entry = postings.find(word);
+    if (entry == postings.end())
+    {
+        return;
+    }
+    QVector<int> &ids = entry->second;
+    auto it = std::lower_bound(ids.begin(), ids.end(), cardId);
+    if (it != ids.end() && *it == cardId)
+    {
+        ids.erase(it);
+    }
+    if (ids.isEmpty())
+    {
+        postings.erase(entry);
+    }
+}
+
+void CardSearchIndex::insert(int cardId, const Card &card)
+{
+    const QStringList front = tokenize(card.frontSide);
+    const QStringList back = tokenize(card.backSide);
+    for (const QString &word : QSet<QString>(front.constBegin(), front.constEnd()))
+    {
+        addPosting(frontWords[word], cardId);
+    }
+    for (const QString &word : QSet<QString>(back.constBegin(), back.constEnd()))
+    {
+        addPosting(backWords[word], cardId);
+    }
+    cards.insert(cardId, card);
+    idByUid.insert(card.uid, cardId);
+}
+
+void CardSearchIndex::remove(int cardId)
+{
+    auto it = cards.find(cardId);
+    if (it == cards.end())
+    {
+        return;
+    }
+    for (const QString &word : tokenize(it->frontSide))
+    {
+        removePosting(frontWords, word, cardId);
+    }
+    for (const QString &word : tokenize(it->backSide))
+    {
+        removePosting(backWords, word, cardId);
+    }
+    idByUid.remove(it->uid);
+    cards.erase(it);
+}
+
+bool CardSearchIndex::refresh(DBManager &dbManager)
+{
+    // Same cursor as the sync engine: rows pulled from the server keep their origin's updated_at,
+    // which can lie behind the mark, but get a new change_seq when they are written here
+    const qint64 horizon = dbManager.changeHorizon();
+    if (horizon < 0)
+    {
+        return false;
+    }
+    if (changedMark < 0)
+    {
+        // Tombstones written before the first load are for cards that won't be loaded
+        PooledQuery deleted = dbManager.executeQuery("SELECT COALESCE(max(change_seq), 0) FROM deleted_rows");
+        if (!deleted.next())
+        {
+            return false;
+        }
+        deletedMark = deleted.value(0).toLongLong();
+    }
+
+    // Keyset on the change index, an unchanged deck costs one empty range scan
+    PooledQuery changed = dbManager.executeQuery("SELECT id, deck_id, uid, frontSide, backSide, change_seq FROM flashcards "
+                                               "WHERE (change_seq, uid) > (?, ?) AND change_seq < ? ORDER BY change_seq, uid",
+                                               QVariantList() << changedMark << changedUid << horizon);
+    if (changed.lastError().type() != QSqlError::NoError)
+    {
+        return false;
+    }
+    while (changed.next())
+    {
+        const int cardId = changed.value(0).toInt();
+        Card card;
+        card.deckId = changed.value(1).toInt();
+        card.uid = changed.value(2).toString();
+        card.frontSide = changed.value(3).toString();
+        card.backSide = changed.value(4).toString();
+        remove(cardId);
+        insert(cardId, card);
+        changedMark = changed.value(5).toLongLong();
+        changedUid = card.uid;
+    }
+    changedMark = qMax<qint64>(changedMark, 0);
+
+    PooledQuery deleted = dbManager.executeQuery("SELECT uid, change_seq FROM deleted_rows WHERE (change_seq, uid) > (?, ?) AND change_seq < ? ORDER BY change_seq, uid",
+                                               QVariantList() << deletedMark << deletedUid << horizon);
+    if (deleted.lastError().type() != QSqlError::NoError)
+    {
+        return false;
+    }
+    while (deleted.next())
+    {
+        deletedUid = deleted.value(0).toString();
+        deletedMark = deleted.value(1).toLongLong();
+        remove(idByUid.value(deletedUid, -1));
+    }
+    return true;
+}
+
+int CardSearchIndex::size() const
+{
+    return cards.size();
+}
+
+void CardSearchIndex::match(const Postings &postings, const QString &word, bool prefix, int exactWeight, QHash<int, int> &best)
+{
+    auto it = prefix ? postings.lower_bound(word) : postings.find(word);
+    for (; it != postings.end() && it->first.startsWith(word); ++it)
+    {
+        // A whole word counts more than a word that only starts with it
+        const int weight = it->first.size() == word.size() ? exactWeight : exactWeight - 1;
+        for (int cardId : it->second)
+        {
+            int &score = best[cardId];
+            score = qMax(score, weight);
+        }
+        if (!prefix)
+        {
+            break;
+        }
+    }
+}
+
+QVector<SearchHit> CardSearchIndex::search(const QString &text, double afterRank, int afterCardId, int limit) const
+{
+    QVector<SearchHit> hits;
+    const QStringList words = tokenize(text);
+    if (words.isEmpty() || limit <= 0)
+    {
+        return hits;
+    }
+    // Per query word the best weight of each card containing it: front side 4, back side 2, one less for a prefix
+    QVector<QHash<int, int>> perWord;
+    int smallest = 0;
+    for (int i = 0; i < words.size(); ++i)
+    {
+        const bool prefix = i == words.size() - 1 && words.at(i).size() >= minPrefixLength;
+        QHash<int, int> best;
+        match(frontWords, words.at(i), prefix, 4, best);
+        match(backWords, words.at(i), prefix, 2, best);
+        if (best.isEmpty())
+        {
+            return hits;
+        }
+        if (best.size() < perWord.value(smallest).size())
+        {
+            smallest = perWord.size();
+        }
+        perWord.append(best);
+    }
+
+    // Only cards in the rarest word's list can contain every word
+    for (auto it = perWord.at(smallest).constBegin(); it != perWord.at(smallest).constEnd(); ++it)
+    {
+        int score = 0;
+        bool all = true;
+        for (const QHash<int, int> &best : perWord)
+        {
+            const int weight = best.value(it.key());
+            if (weight == 0)
+            {
+                all = false;
+                break;
+            }
+            score += weight;
+        }
+        const double rank = score;
+        if (all && (rank < afterRank || (rank == afterRank && it.key() > afterCardId)))
+        {
+            SearchHit hit;
+            hit.cardId = it.key();
+            hit.rank = rank;
+            hits.append(hit);
+        }
+    }
+    auto better = [](const SearchHit &a, const SearchHit &b) {
+        return a.rank != b.rank ? a.rank > b.rank : a.cardId < b.cardId;
+    };
+    const int count = qMin(limit, hits.size());
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(), better);
+    hits.resize(count);
+    for (SearchHit &hit : hits)
+    {
+        const Card &card = cards[hit.cardId];
+        hit.deckId = card.deckId;
+        hit.frontSide = card.frontSide;
+        hit.backSide = card.backSide;
+    }
+    return hits;
+}
+
+// One page of a search as it comes back from the search thread
+struct SearchPage
+{
+    bool stale = false;
+    QVector<SearchHit> hits;
+    QString error;
+};
+
+// SQLSTATE of a statement cancelled by statement_timeout or pg_cancel_backend
+static const QString queryCanceled = "57014";
+
+CardSearch::CardSearch(const DBManager &dbManager, QObject *parent)
+    : QObject(parent)
+    , worker(new AsyncDBManager(dbManager, this))
+    , canceller(dbManager.isSqlite() ? nullptr : new AsyncDBManager(dbManager, this))
+    , local(dbManager.isSqlite())
+    , index(QSharedPointer<CardSearchIndex>::create())
+    , latest(QSharedPointer<QAtomicInt>::create(0))
+    , backendPid(QSharedPointer<QAtomicInt>::create(0))
+    , running(QSharedPointer<QAtomicInt>::create(0)) {}
+
+void CardSearch::setPageSize(int hits)
+{
+    pageSize = qMax(1, hits);
+}
+
+void CardSearch::warmUp()
+{
+    QSharedPointer<CardSearchIndex> cards = index;
+    const bool useIndex = local;
+    QSharedPointer<QAtomicInt> pid = backendPid;
+    worker->run([cards, useIndex, pid](DBManager &db) {
+        if (useIndex)
+        {
+            QElapsedTimer clock;
+            clock.start();
+            cards->refresh(db);
+            qDebug() << "Search index holds" << cards->size() << "cards, built in" << clock.elapsed() << "ms";
+        }
+        else
+        {
+            // Session setting of the search thread's own connection, other work is unaffected
+            db.executeQuery(QString("SET statement_timeout = %1").arg(statementTimeoutMs));
+            PooledQuery backend = db.executeQuery("SELECT pg_backend_pid()");
+            if (backend.next())
+            {
+                pid->storeRelease(backend.value(0).toInt());
+            }
+        }
+        return true;
+    }, this, [](bool) {});
+}
+
+QString CardSearch::tsQuery(const QString &text)
+{
+    // Only letters and digits reach to_tsquery, so the text can't inject operators
+    QStringList words;
+    QString word;
+    for (const QChar c : text.toLower() + ' ')
+    {
+        if (c.isLetterOrNumber())
+        {
+            word += c;
+        }
+        else if (!word.isEmpty())
+        {
+            words.append(word);
+            word.clear();
+        }
+    }
+    if (words.isEmpty())
+    {
+        return QString();
+    }
+    if (words.last().size() >= minPrefixLength)
+    {
+        words.last() += ":*";
+    }
+    return words.join(" & ");
+}
+
+void CardSearch::search(const QString &newText, QObject *context, PageCallback onPage)
+{
+    cancel();
+    text = newText.trimmed();
+    if (text.isEmpty())
+    {
+        return;
+    }
+    lastRank = std::numeric_limits<double>::max();
+    lastCardId = 0;
+    exhausted = false;
+    runPage(context, onPage);
+}
+
+void CardSearch::fetchMore(QObject *context, PageCallback onPage)
+{
+    if (loading || exhausted)
+    {
+        return;
+    }
+    runPage(context, onPage);
+}
+
+void CardSearch::cancel()
+{
+    // Searches already queued see the new generation and skip the database
+    latest->storeRelease(++generation);
+    loading = false;
+    exhausted = true;
+    // A statement still running for older text would hold up the new one until it finishes
+    const int pid = backendPid->loadAcquire();
+    if (canceller && pid != 0 && running->loadAcquire() != 0)
+    {
+        canceller->run([pid](DBManager &db) {
+            PooledQuery query = db.executeQuery("SELECT pg_cancel_backend(?)", QVariantList() << pid);
+            return query.lastError().type() == QSqlError::NoError;
+        }, this, [](bool) {});
+    }
+}
+
+void CardSearch::runPage(QObject *context, PageCallback onPage)
+{
+    loading = true;
+    const int requested = generation;
+    const QString query = text;
+    const double afterRank = lastRank;
+    const int afterCardId = lastCardId;
+    // One extra hit tells whether there is another page
+    const int limit = pageSize + 1;
+    const bool useIndex = local;
+    QSharedPointer<CardSearchIndex> cards = index;
+    QSharedPointer<QAtomicInt> current = latest;
+    QSharedPointer<QAtomicInt> statement = running;
+    QPointer<QObject> guard(context);
+    worker->run([=](DBManager &db) {
+        SearchPage page;
+        if (current->loadAcquire() != requested)
+        {
+            page.stale = true;
+            return page;
+        }
+        if (useIndex)
+        {
+            cards->refresh(db);
+            page.hits = cards->search(query, afterRank, afterCardId, limit);
+        }
+        else
+        {
+            const QString tsQuery = CardSearch::tsQuery(query);
+            // A cancel meant for an older search can land on this one once that one finished.
+            // Cancelled before the timeout and still current means exactly that, so it runs again.
+            for (int attempt = 0; attempt < 2 && !tsQuery.isEmpty(); ++attempt)
+            {
+                QElapsedTimer clock;
+                clock.start();
+                QSqlError error;
+                statement->storeRelease(requested);
+                page.hits = db.searchFlashcards(tsQuery, afterRank, afterCardId, limit, &error);
+                statement->storeRelease(0);
+                if (error.type() == QSqlError::NoError)
+                {
+                    break;
+                }
+                if (current->loadAcquire() != requested)
+                {
+                    page.stale = true;
+                    break;
+                }
+                const bool cancelled = error.nativeErrorCode() == queryCanceled;
+                if (cancelled && clock.elapsed() < statementTimeoutMs && attempt == 0)
+                {
+                    continue;
+                }
+                page.error = cancelled ? QObject::tr("The search took too long, type more of the word.") : QObject::tr("The search failed.");
+                break;
+            }
+        }
+        return page;
+    }, this, [this, requested, guard, onPage](const SearchPage &page) {
+        if (page.stale || requested != generation)
+        {
+            return;
+        }
+        loading = false;
+        QVector<SearchHit> hits = page.hits;
+        const bool more = hits.size() > pageSize;
+        if (more)
+        {
+            hits.resize(pageSize);
+        }
+        exhausted = !more;
+        if (!hits.isEmpty())
+        {
+            lastRank = hits.last().rank;
+            lastCardId = hits.last().cardId;
+        }
+        if (guard)
+        {
+            onPage(hits, more, page.error);
+        }
+    });
+}
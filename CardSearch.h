@@ -0,0 +1,110 @@
+#ifndef CARDSEARCH_H
+#define CARDSEARCH_H
+
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include <map>
+#include "AsyncDBManager.h"
+#include "DBManager.h"
+
+// Inverted index over the cards of every deck, used by the local backend
+// where there is no server-side text index. Each word maps to the sorted
+// ids of the cards whose front or back side contains it. refresh() reads
+// only the cards changed since the previous call (by change_seq, as the
+// sync engine does) and the new tombstones in deleted_rows, so after the first load an edit costs a
+// few index probes. The last word of a query also matches longer words
+// starting with it, the words are kept sorted so that is a range scan.
+class CardSearchIndex
+{
+public:
+    bool refresh(DBManager &dbManager);
+    // Cards containing every word of text, best first, after the (rank, card id) position given
+    QVector<SearchHit> search(const QString &text, double afterRank, int afterCardId, int limit) const;
+    int size() const;
+
+    // Lowercased words without accents, split at anything that is not a letter or digit
+    static QStringList tokenize(const QString &text);
+
+private:
+    struct Card
+    {
+        int deckId = -1;
+        QString uid;
+        QString frontSide;
+        QString backSide;
+    };
+    using Postings = std::map<QString, QVector<int>>;
+
+    void insert(int cardId, const Card &card);
+    void remove(int cardId);
+    // Best weight per card for one query word in one side's postings
+    static void match(const Postings &postings, const QString &word, bool prefix, int exactWeight, QHash<int, int> &best);
+
+    QHash<int, Card> cards;
+    QHash<QString, int> idByUid;
+    Postings frontWords;
+    Postings backWords;
+    qint64 changedMark = -1;
+    QString changedUid;
+    qint64 deletedMark = -1;
+    QString deletedUid;
+};
+
+// Search-as-you-type over the cards of every deck. Postgres answers from the
+// full-text index on flashcards, the local backend from a CardSearchIndex
+// built on the search thread. Searches run on their own thread and
+// connection so typing never waits behind other database work. Every
+// keystroke replaces the running search: queued searches for older text
+// are skipped before they reach the database, a statement still running
+// on Postgres is cancelled, and results for older text are dropped.
+class CardSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    // error is empty unless the search failed or took too long
+    using PageCallback = std::function<void(const QVector<SearchHit> &hits, bool more, const QString &error)>;
+
+    CardSearch(const DBManager &dbManager, QObject *parent = nullptr);
+
+    void setPageSize(int hits);
+    // Loads the local index ahead of the first keystroke, nothing to do on Postgres
+    void warmUp();
+    // First page for text, blank text only cancels
+    void search(const QString &text, QObject *context, PageCallback onPage);
+    // Next page of the current search, after the last hit delivered
+    void fetchMore(QObject *context, PageCallback onPage);
+    void cancel();
+
+    // to_tsquery text for what was typed so far, the last word matching as a prefix
+    static QString tsQuery(const QString &text);
+
+private:
+    void runPage(QObject *context, PageCallback onPage);
+
+    AsyncDBManager *worker;
+    // Sends pg_cancel_backend for the search thread's connection while it is busy, Postgres only
+    AsyncDBManager *canceller;
+    bool local;
+    // Only touched on the search thread
+    QSharedPointer<CardSearchIndex> index;
+    QSharedPointer<QAtomicInt> latest;
+    // Backend process of the search connection and the generation of the statement it runs, 0 when idle
+    QSharedPointer<QAtomicInt> backendPid;
+    QSharedPointer<QAtomicInt> running;
+    int generation = 0;
+    int pageSize = 50;
+    QString text;
+    double lastRank = 0;
+    int lastCardId = 0;
+    bool loading = false;
+    bool exhausted = true;
+};
+
+#endif // CARDSEARCH_H
@@ -0,0 +1,109 @@
+#include "CardStore.h"
+
+#include <algorithm>
+
+CardStore::CardStore(int deckId)
+    : deck(deckId) {}
+
+QSharedPointer<CardStore> CardStore::load(DBManager &dbManager, int deckId)
+{
+    QSharedPointer<CardStore> store = QSharedPointer<CardStore>::create(deckId);
+    PooledQuery query = dbManager.executeQuery("SELECT id, frontSide FROM flashcards WHERE deck_id = ? ORDER BY id", QVariantList() << deckId);
+    if (query.lastError().type() != QSqlError::NoError)
+    {
+        return QSharedPointer<CardStore>();
+    }
+    while (query.next())
+    {
+        store->append(query.value(0).toInt(), query.value(1).toString());
+    }
+    store->fronts.squeeze();
+    return store;
+}
+
+void CardStore::append(int cardId, const QString &frontSide)
+{
+    // Rows arrive in id order, which keeps indexOf a binary search
+    ids.append(cardId);
+    fronts += frontSide;
+    frontOffsets.append(fronts.size());
+    backOffsets.append(0);
+    backLengths.append(-1);
+    backCapacities.append(0);
+}
+
+int CardStore::deckId() const
+{
+    return deck;
+}
+
+int CardStore::size() const
+{
+    return ids.size();
+}
+
+bool CardStore::isEmpty() const
+{
+    return ids.isEmpty();
+}
+
+int CardStore::cardId(int index) const
+{
+    return ids.at(index);
+}
+
+int CardStore::indexOf(int cardId) const
+{
+    auto it = std::lower_bound(ids.constBegin(), ids.constEnd(), cardId);
+    return it != ids.constEnd() && *it == cardId ? int(it - ids.constBegin()) : -1;
+}
+
+QString CardStore::frontSide(int index) const
+{
+    return fronts.mid(frontOffsets.at(index), frontOffsets.at(index + 1) - frontOffsets.at(index));
+}
+
+bool CardStore::hasBackSide(int index) const
+{
+    return backLengths.at(index) >= 0;
+}
+
+QString CardStore::backSide(int index) const
+{
+    return hasBackSide(index) ? backs.mid(backOffsets.at(index), backLengths.at(index)) : QString();
+}
+
+void CardStore::setBackSide(int index, const QString &backSide)
+{
+    if (backSide.size() <= backCapacities.at(index))
+    {
+        backs.replace(backOffsets.at(index), backSide.size(), backSide);
+        backLengths[index] = backSide.size();
+        return;
+    }
+    wastedBacks += backCapacities.at(index);
+    backOffsets[index] = backs.size();
+    backLengths[index] = backSide.size();
+    backCapacities[index] = backSide.size();
+    backs += backSide;
+    if (wastedBacks > backs.size() / 2)
+    {
+        compactBacks();
+    }
+}
+
+void CardStore::compactBacks()
+{
+    QString packed;
+    packed.reserve(backs.size() - wastedBacks);
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        const int length = qMax(0, backLengths.at(i));
+        const int offset = packed.size();
+        packed.append(backs.constData() + backOffsets.at(i), length);
+        backOffsets[i] = offset;
+        backCapacities[i] = length;
+    }
+    backs = packed;
+    wastedBacks = 0;
+}
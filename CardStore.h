@@ -0,0 +1,60 @@
+#ifndef CARDSTORE_H
+#define CARDSTORE_H
+
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "DBManager.h"
+
+// The cards of one deck, loaded once and shared by the flashcard view and
+// the exercise prefetcher. Front sides are packed into a single string with
+// an offset per card, so a deck costs a few bytes per card on top of its
+// text. Back sides are only read when a card's answer is needed. Cards are
+// ordered by id and keep their index for the lifetime of the store.
+class CardStore
+{
+public:
+    CardStore() = default;
+    explicit CardStore(int deckId);
+    CardStore(CardStore &&other) noexcept = default;
+    CardStore &operator=(CardStore &&other) noexcept = default;
+    CardStore(const CardStore &) = delete;
+    CardStore &operator=(const CardStore &) = delete;
+
+    // Reads ids and front sides of the deck, null if the query failed
+    static QSharedPointer<CardStore> load(DBManager &dbManager, int deckId);
+
+    int deckId() const;
+    int size() const;
+    bool isEmpty() const;
+    int cardId(int index) const;
+    // -1 if the card is not in the deck
+    int indexOf(int cardId) const;
+    QString frontSide(int index) const;
+    bool hasBackSide(int index) const;
+    // Empty until the back side was loaded
+    QString backSide(int index) const;
+    // Overwrites the card's slot when the new text fits, the space left behind
+    // by moved back sides is reclaimed once it outweighs the live text
+    void setBackSide(int index, const QString &backSide);
+
+    void append(int cardId, const QString &frontSide);
+
+private:
+    int deck = -1;
+    QVector<int> ids;
+    QVector<int> frontOffsets = {0};
+    QString fronts;
+    void compactBacks();
+
+    // Offset and length of each back side in backs, length -1 until loaded
+    QVector<int> backOffsets;
+    QVector<int> backLengths;
+    // Room reserved for each back side, at least its length
+    QVector<int> backCapacities;
+    QString backs;
+    // Characters of backs no card refers to any more
+    int wastedBacks = 0;
+};
+
+#endif // CARDSTORE_H
@@ -0,0 +1,304 @@
+#include "ConnectionPool.h"
+
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+
+// A connection idle for longer than this is checked with SELECT 1 before it is handed out
+static const qint64 healthCheckIdleMs = 30000;
+// An unreachable server fails the connect after this many seconds instead of libpq's default of waiting indefinitely
+static const int connectTimeoutSeconds = 3;
+// SQLite writers wait this long for a lock held by another connection before giving up
+static const int sqliteBusyTimeoutMs = 5000;
+// Upper bound on cached statements per connection, only reached if callers build SQL dynamically
+static const int maxCachedStatements = 64;
+
+ConnectionPool::Connection::Connection(ConnectionPool *pool, const QString &name)
+    : pool(pool), name(name) {}
+
+ConnectionPool::Connection::Connection(Connection &&other) noexcept
+    : pool(other.pool), name(other.name)
+{
+    other.pool = nullptr;
+}
+
+ConnectionPool::Connection &ConnectionPool::Connection::operator=(Connection &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        name = other.name;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Connection::~Connection()
+{
+    release();
+}
+
+void ConnectionPool::Connection::release()
+{
+    if (pool) {
+        pool->release(name);
+        pool = nullptr;
+    }
+}
+
+bool ConnectionPool::Connection::isValid() const
+{
+    return pool != nullptr;
+}
+
+QSqlDatabase ConnectionPool::Connection::database() const
+{
+    return pool ? QSqlDatabase::database(name, false) : QSqlDatabase();
+}
+
+QSqlQuery ConnectionPool::Connection::prepared(const QString &sql) const
+{
+    if (!pool) {
+        return QSqlQuery(QSqlDatabase());
+    }
+    QHash<QString, QSqlQuery> &statements = threadStatements(name);
+    auto it = statements.constFind(sql);
+    const bool cached = it != statements.constEnd();
+    // A caller further up may still be reading the cached statement's rows, so a busy one gets a fresh copy
+    if (cached && !it.value().isActive()) {
+        pool->statementsReused.fetchAndAddRelaxed(1);
+        return it.value();
+    }
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    if (!query.prepare(sql)) {
+        qDebug() << "Failed to prepare statement:" << query.lastError().text();
+        return query;
+    }
+    pool->statementsPrepared.fetchAndAddRelaxed(1);
+    if (cached) {
+        return query;
+    }
+    if (statements.size() >= maxCachedStatements) {
+        statements.clear();
+    }
+    statements.insert(sql, query);
+    return query;
+}
+
+PooledQuery::PooledQuery(ConnectionPool::Connection connection, const QSqlQuery &query)
+    : PooledQueryCheckout(std::move(connection)), QSqlQuery(query) {}
+
+PooledQuery &PooledQuery::operator=(PooledQuery &&other)
+{
+    if (this != &other) {
+        // The old query is done with before its checkout goes
+        if (checkout.isValid()) {
+            finish();
+        }
+        QSqlQuery::operator=(other);
+        checkout = std::move(other.checkout);
+    }
+    return *this;
+}
+
+PooledQuery::~PooledQuery()
+{
+    // A moved-from query has no checkout and may still share its result with the new owner
+    if (checkout.isValid()) {
+        finish();
+    }
+}
+
+ConnectionPool::ConnectionPool(const QString &host, const QString &dbName, const QString &user, int port, int maxConnections)
+    : ConnectionPool("QPSQL", host, dbName, user, port, maxConnections) {}
+
+ConnectionPool::ConnectionPool(const QString &driver, const QString &host, const QString &dbName, const QString &user, int port, int maxConnections)
+    : dbDriver(driver), dbHost(host), dbName(dbName), dbUser(user), dbPort(port), maxSize(qMax(1, maxConnections)) {}
+
+ConnectionPool::~ConnectionPool()
+{
+    // Other threads' connections were closed when those threads finished
+    closeThreadConnection();
+}
+
+void ConnectionPool::setMaxConnections(int maxConnections)
+{
+    QMutexLocker locker(&mutex);
+    maxSize = qMax(1, maxConnections);
+    slotFreed.wakeAll();
+}
+
+QString ConnectionPool::driverName() const
+{
+    return dbDriver;
+}
+
+int ConnectionPool::maxConnections() const
+{
+    QMutexLocker locker(&mutex);
+    return maxSize;
+}
+
+QHash<QString, QSqlQuery> &ConnectionPool::threadStatements(const QString &name)
+{
+    // Statements belong to the thread's connection, so they live in thread-local storage
+    static thread_local QHash<QString, QHash<QString, QSqlQuery>> statements;
+    return statements[name];
+}
+
+QString ConnectionPool::threadConnectionName() const
+{
+    return QString("pool-%1-%2").arg(quintptr(this), 0, 16).arg(quintptr(QThread::currentThreadId()), 0, 16);
+}
+
+ConnectionPool::Connection ConnectionPool::acquire(int timeoutMs)
+{
+    const QString name = threadConnectionName();
+    bool firstCheckout = false;
+    bool known = false;
+    qint64 idleMs = 0;
+    {
+        QMutexLocker locker(&mutex);
+        known = entries.contains(name);
+        const bool guiThread = QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread();
+        if (entries.value(name).checkouts == 0) {
+            // The thread holds no slot yet. Workers wait for one of theirs, the GUI thread has its own and never blocks.
+            if (!guiThread) {
+                QDeadlineTimer deadline(timeoutMs);
+                while (inUse >= qMax(1, maxSize - 1)) {
+                    if (!slotFreed.wait(&mutex, deadline)) {
+                        qDebug() << "No free database connection within" << timeoutMs << "ms";
+                        return Connection();
+                    }
+                }
+                inUse++;
+            }
+            firstCheckout = true;
+        }
+        Entry &entry = entries[name];
+        if (firstCheckout) {
+            entry.counted = !guiThread;
+        }
+        entry.checkouts++;
+        if (known) {
+            idleMs = QDateTime::currentMSecsSinceEpoch() - entry.lastUsed;
+        }
+    }
+
+    // Only this thread ever touches its own connection, no lock needed from here on
+    QSqlDatabase db = QSqlDatabase::contains(name) ? QSqlDatabase::database(name, false) : QSqlDatabase::addDatabase(dbDriver, name);
+    if (!known) {
+        QWeakPointer<ConnectionPool> weak = sharedFromThis();
+        if (!weak.isNull() && QThread::currentThread() != nullptr) {
+            QObject::connect(QThread::currentThread(), &QThread::finished, [weak]() {
+                if (QSharedPointer<ConnectionPool> pool = weak.toStrongRef()) {
+                    pool->closeThreadConnection();
+                }
+            });
+        }
+    }
+
+    bool ok = true;
+    if (!db.isOpen()) {
+        ok = open(db);
+    } else if (firstCheckout && idleMs > healthCheckIdleMs && !isHealthy(db)) {
+        qDebug() << "Database connection" << name << "went away, reconnecting.";
+        threadStatements(name).clear();
+        db.close();
+        ok = open(db);
+    }
+    if (!ok) {
+        release(name);
+        return Connection();
+    }
+    return Connection(this, name);
+}
+
+bool ConnectionPool::open(QSqlDatabase &db) const
+{
+    const bool sqlite = dbDriver == "QSQLITE";
+    db.setDatabaseName(dbName);
+    if (sqlite) {
+        db.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%1").arg(sqliteBusyTimeoutMs));
+    } else {
+        db.setHostName(dbHost);
+        db.setUserName(dbUser);
+        db.setPassword("secure_password");
+        db.setPort(dbPort);
+        db.setConnectOptions(QString("connect_timeout=%1").arg(connectTimeoutSeconds));
+    }
+    if (!db.open())
+    {
+        qDebug() << "Error: Could not connect to the database.";
+        qDebug() << db.lastError().text();
+        return false;
+    }
+    if (sqlite) {
+        // WAL lets the UI thread read while a worker writes, synchronous=NORMAL is durable
+        // across application crashes and only syncs at checkpoints. Foreign keys are per connection.
+        QSqlQuery pragma(db);
+        for (const char *statement : {"PRAGMA journal_mode=WAL", "PRAGMA synchronous=NORMAL", "PRAGMA foreign_keys=ON"}) {
+            if (!pragma.exec(statement)) {
+                qDebug() << "Failed to configure SQLite connection:" << pragma.lastError().text();
+            }
+        }
+    }
+    qDebug() << "Database connection" << db.connectionName() << "opened.";
+    return true;
+}
+
+bool ConnectionPool::isHealthy(QSqlDatabase &db) const
+{
+    QSqlQuery query(db);
+    return query.exec("SELECT 1");
+}
+
+void ConnectionPool::release(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    auto it = entries.find(name);
+    if (it == entries.end() || it->checkouts == 0) {
+        return;
+    }
+    if (--it->checkouts == 0) {
+        it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+        if (it->counted) {
+            inUse--;
+            slotFreed.wakeOne();
+        }
+    }
+}
+
+void ConnectionPool::closeThreadConnection()
+{
+    const QString name = threadConnectionName();
+    {
+        QMutexLocker locker(&mutex);
+        if (entries.value(name).checkouts > 0) {
+            qDebug() << "Database connection" << name << "is still checked out, not closing it.";
+            return;
+        }
+        entries.remove(name);
+    }
+    // Cached statements hold the connection, they have to go before it is removed
+    threadStatements(name).clear();
+    if (QSqlDatabase::contains(name)) {
+        {
+            QSqlDatabase db = QSqlDatabase::database(name, false);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+void ConnectionPool::logStats() const
+{
+    qDebug() << "Prepared statements:" << statementsPrepared.loadRelaxed() << "prepared," << statementsReused.loadRelaxed() << "reused";
+}
@@ -0,0 +1,125 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QAtomicInt>
+#include <QEnableSharedFromThis>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <utility>
+
+// Hands out one named connection per thread, QSqlDatabase
+// connections must not be used from any other thread than the one that
+// opened them. At most maxConnections threads hold a connection at a time,
+// one slot is kept for the GUI thread so it never waits, further worker
+// threads wait for a free slot. Connections are opened on first
+// use, checked with a cheap query after sitting idle and reopened if the
+// server went away, and closed when their thread finishes. Each
+// connection keeps its prepared statements so that repeated queries skip
+// the parse/plan round-trip. The driver is QPSQL for the shared Postgres
+// database or QSQLITE for the embedded one, whose database name is the file
+// path and whose connections run in WAL mode so readers never block the writer.
+class ConnectionPool : public QEnableSharedFromThis<ConnectionPool>
+{
+public:
+    // Checked-out connection, returns its slot to the pool when it goes out of scope.
+    // Nested checkouts on the same thread share the connection and the slot.
+    class Connection
+    {
+    public:
+        Connection() = default;
+        Connection(Connection &&other) noexcept;
+        Connection &operator=(Connection &&other) noexcept;
+        Connection(const Connection &) = delete;
+        Connection &operator=(const Connection &) = delete;
+        ~Connection();
+
+        bool isValid() const;
+        QSqlDatabase database() const;
+        // Prepared, forward-only statement reused for the same SQL on this connection.
+        // While the cached one is still active a fresh statement is prepared instead,
+        // so a nested execution of the same SQL never resets rows being read.
+        QSqlQuery prepared(const QString &sql) const;
+
+    private:
+        friend class ConnectionPool;
+        Connection(ConnectionPool *pool, const QString &name);
+        void release();
+
+        ConnectionPool *pool = nullptr;
+        QString name;
+    };
+
+    ConnectionPool(const QString &host, const QString &dbName, const QString &user, int port, int maxConnections = 4);
+    ConnectionPool(const QString &driver, const QString &host, const QString &dbName, const QString &user, int port, int maxConnections = 4);
+    ~ConnectionPool();
+
+    QString driverName() const;
+
+    void setMaxConnections(int maxConnections);
+    int maxConnections() const;
+    // Waits up to timeoutMs for a free slot, the result is invalid if none came up or the connection failed
+    Connection acquire(int timeoutMs = 5000);
+    // Closes the calling thread's connection
+    void closeThreadConnection();
+    void logStats() const;
+
+private:
+    struct Entry
+    {
+        int checkouts = 0;
+        qint64 lastUsed = 0;
+        // Whether the checkout takes one of the workers' slots, the GUI thread's doesn't
+        bool counted = false;
+    };
+
+    bool open(QSqlDatabase &db) const;
+    bool isHealthy(QSqlDatabase &db) const;
+    void release(const QString &name);
+    QString threadConnectionName() const;
+    static QHash<QString, QSqlQuery> &threadStatements(const QString &name);
+
+    QString dbDriver;
+    QString dbHost;
+    QString dbName;
+    QString dbUser;
+    int dbPort;
+    int maxSize;
+    int inUse = 0;
+    QHash<QString, Entry> entries;
+    mutable QMutex mutex;
+    QWaitCondition slotFreed;
+    QAtomicInt statementsPrepared;
+    QAtomicInt statementsReused;
+};
+
+// The checkout a PooledQuery holds, a base class of its own so that it is released after the query
+class PooledQueryCheckout
+{
+protected:
+    PooledQueryCheckout() = default;
+    explicit PooledQueryCheckout(ConnectionPool::Connection connection)
+        : checkout(std::move(connection)) {}
+
+    ConnectionPool::Connection checkout;
+};
+
+// A query that keeps its connection checked out for as long as it exists, so
+// the pool can neither hand the slot to another thread nor close or reopen the
+// connection while rows are still being read. Move-only like the checkout.
+// Destroying it finishes the query, which hands a cached statement back for
+// reuse; a copy sliced to QSqlQuery must not outlive it.
+class PooledQuery : private PooledQueryCheckout, public QSqlQuery
+{
+public:
+    PooledQuery() = default;
+    PooledQuery(ConnectionPool::Connection connection, const QSqlQuery &query);
+    PooledQuery(PooledQuery &&other) = default;
+    PooledQuery &operator=(PooledQuery &&other);
+    ~PooledQuery();
+};
+
+#endif // CONNECTIONPOOL_H
@@ -1,78 +1,346 @@
 #include "DBManager.h"
 
-DBManager::DBManager(const QString& host, const QString& dbName, const QString& user, int port)
-    : dbHost(host), dbName(dbName), dbUser(user), dbPort(port)  {}
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QSet>
+#include "SchemaMigrations.h"
+
+// Per-query tracing costs a string copy and a log call on every statement, so it is compiled in
+// only with -DDBMANAGER_TRACE and then enabled with QT_LOGGING_RULES="db.sql.debug=true"
+#ifdef DBMANAGER_TRACE
+Q_LOGGING_CATEGORY(lcSql, "db.sql", QtInfoMsg)
+#define SQL_TRACE qCDebug(lcSql)
+#else
+#define SQL_TRACE while (false) qDebug()
+#endif
+
+DBManager::DBManager(const QString& host, const QString& dbName, const QString& user, int port, int poolSize)
+    : pool(QSharedPointer<ConnectionPool>::create(host, dbName, user, port, poolSize)) {}
+DBManager::DBManager(const QSharedPointer<ConnectionPool> &pool, StorageBackend backend)
+    : pool(pool), storage(backend) {}
+DBManager DBManager::sqlite(const QString &path, int poolSize)
+{
+    return DBManager(QSharedPointer<ConnectionPool>::create("QSQLITE", QString(), path, QString(), 0, poolSize), StorageBackend::Sqlite);
+}
+StorageBackend DBManager::backend() const
+{
+    return storage;
+}
+bool DBManager::isSqlite() const
+{
+    return storage == StorageBackend::Sqlite;
+}
+QVariant DBManager::timestampValue(const QDateTime &time) const
+{
+    // Same format as the strftime default of the SQLite schema, so stored and bound values compare as text
+    if (isSqlite())
+    {
+        return time.toUTC().toString("yyyy-MM-ddThh:mm:ss.zzzZ");
+    }
+    return time;
+}
+QDateTime DBManager::toDateTime(const QVariant &value)
+{
+    if (value.userType() == QMetaType::QString)
+    {
+        return QDateTime::fromString(value.toString(), Qt::ISODateWithMs);
+    }
+    return value.toDateTime();
+}
+void DBManager::setPoolSize(int poolSize)
+{
+    pool->setMaxConnections(poolSize);
+}
 bool DBManager::connect()
 {
-    db = QSqlDatabase::addDatabase("QPSQL");
-    db.setHostName(dbHost);
-    db.setDatabaseName(dbName);
-    db.setUserName(dbUser);
-    db.setPassword("secure_password");
-    db.setPort(dbPort);
-    if (!db.open())
+    // Opens the calling thread's pooled connection now instead of on the first query
+    ConnectionPool::Connection connection = pool->acquire();
+    if (!connection.isValid())
     {
         qDebug() << "Error: Could not connect to the database.";
-        qDebug() << db.lastError().text();
         return false;
     }
     qDebug() << "Database connected successfully!";
     return true;
 }
-QSqlQuery DBManager::executeQuery(const QString& query, const QVariantList& values)
+void DBManager::close()
+{
+    pool->closeThreadConnection();
+}
+bool DBManager::migrate()
+{
+    // DDL is transactional in PostgreSQL and SQLite, a failed step leaves the schema as it was
+    PooledQuery query = executeQuery(isSqlite()
+        ? "CREATE TABLE IF NOT EXISTS schema_version ( version INTEGER PRIMARY KEY, description TEXT NOT NULL, applied_at TEXT NOT NULL DEFAULT CURRENT_TIMESTAMP )"
+        : "CREATE TABLE IF NOT EXISTS schema_version ( version INTEGER PRIMARY KEY, description TEXT NOT NULL, applied_at TIMESTAMPTZ NOT NULL DEFAULT now() )");
+    if (query.lastError().type() != QSqlError::NoError || !beginTransaction())
+    {
+        qDebug() << "Failed to prepare schema migrations:" << query.lastError().text();
+        return false;
+    }
+    // Clients starting at the same time wait here instead of migrating twice,
+    // an SQLite file takes the write lock with the first statement that changes it
+    if (!isSqlite())
+    {
+        query = executeQuery("LOCK TABLE schema_version IN EXCLUSIVE MODE");
+    }
+    query = executeQuery("SELECT COALESCE(max(version), 0) FROM schema_version");
+    if (query.lastError().type() != QSqlError::NoError || !query.next())
+    {
+        qDebug() << "Failed to read the schema version:" << query.lastError().text();
+        rollbackTransaction();
+        return false;
+    }
+    const int current = query.value(0).toInt();
+    const QVector<Migration> &migrations = isSqlite() ? sqliteSchemaMigrations() : schemaMigrations();
+    for (const Migration &migration : migrations)
+    {
+        if (migration.version <= current)
+        {
+            continue;
+        }
+        for (const QString &statement : migration.statements)
+        {
+            query = executeQuery(statement);
+            if (query.lastError().type() != QSqlError::NoError)
+            {
+                qDebug() << "Schema migration" << migration.version << "(" << migration.description << ") failed:" << query.lastError().text();
+                rollbackTransaction();
+                return false;
+            }
+        }
+        // A step applied but not recorded would run again on the next start
+        query = executeQuery("INSERT INTO schema_version (version, description) VALUES (?, ?)", QVariantList() << migration.version << migration.description);
+        if (query.lastError().type() != QSqlError::NoError)
+        {
+            qDebug() << "Failed to record schema migration" << migration.version << ":" << query.lastError().text();
+            rollbackTransaction();
+            return false;
+        }
+        qDebug() << "Applied schema migration" << migration.version << ":" << migration.description;
+    }
+    if (!commitTransaction())
+    {
+        return false;
+    }
+    qDebug() << "Database schema is at version" << qMax(current, migrations.last().version);
+    return true;
+}
+bool DBManager::subscribe(const QString &channel)
+{
+    // Notifications are delivered on the calling thread, which needs a running event loop
+    ConnectionPool::Connection connection = pool->acquire();
+    QSqlDriver *driver = connection.database().driver();
+    if (!driver || !driver->hasFeature(QSqlDriver::EventNotifications))
+    {
+        return false;
+    }
+    if (driver->subscribedToNotifications().contains(channel))
+    {
+        return true;
+    }
+    if (!driver->subscribeToNotification(channel))
+    {
+        qDebug() << "Failed to listen on" << channel << ":" << driver->lastError().text();
+        return false;
+    }
+    return true;
+}
+QSqlDriver *DBManager::driver()
+{
+    ConnectionPool::Connection connection = pool->acquire();
+    return connection.database().driver();
+}
+QVector<QPair<int, QString>> DBManager::fetchDecks()
+{
+    // Deck ids and names, materialized so the rows can be handed to another thread
+    QVector<QPair<int, QString>> decks;
+    PooledQuery query = executeQuery("SELECT name, id FROM decks", QVariantList());
+    while (query.next())
+    {
+        decks.append(qMakePair(query.value("id").toInt(), query.value("name").toString()));
+    }
+    return decks;
+}
+QVector<QPair<int, QString>> DBManager::fetchDecksPage(int afterId, int limit)
+{
+    // Keyset pagination on the primary key, every page costs the same however far in it is
+    QVector<QPair<int, QString>> decks;
+    PooledQuery query = executeQuery("SELECT id, name FROM decks WHERE id > ? ORDER BY id LIMIT ?", QVariantList() << afterId << limit);
+    while (query.next())
+    {
+        decks.append(qMakePair(query.value(0).toInt(), query.value(1).toString()));
+    }
+    return decks;
+}
+int DBManager::addDeck(const QString &name)
+{
+    // Returns the new deck's id, -1 if the insert failed
+    // RETURNING instead of lastInsertId(), QPSQL reports the row's OID there and tables have none
+    PooledQuery query = executeQuery("INSERT INTO decks (name) VALUES (?) RETURNING id", QVariantList() << name);
+    if (query.lastError().type() != QSqlError::NoError || !query.next())
+    {
+        qDebug() << "Failed to insert deck into the database:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+bool DBManager::removeDeck(int deckId)
+{
+    PooledQuery query = executeQuery("DELETE FROM decks WHERE id = ?", QVariantList() << deckId);
+    if (query.lastError().type() != QSqlError::NoError)
+    {
+        qDebug() << "Failed to delete deck from the database" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+PooledQuery DBManager::prepare(const QString &sql)
 {
-    QSqlQuery q;
-    q.prepare(query); // Prepare the query
+    // The query keeps the connection checked out until the caller is done with its rows
+    ConnectionPool::Connection connection = pool->acquire();
+    const QSqlQuery statement = connection.prepared(sql); // Prepared once per connection, reused afterwards
+    return PooledQuery(std::move(connection), statement);
+}
+PooledQuery DBManager::executeQuery(const QString& query, const QVariantList& values)
+{
+    PooledQuery q = prepare(query);
     // Bind values if any
     for (int i = 0; i < values.size(); ++i)
     {
         q.bindValue(i, values[i]);
     }
+    SQL_TRACE << "Executing prepared query:" << query;
     if (!q.exec())
     {
         qDebug() << "Query execution error: " << q.lastError().text();
     }
     return q;
 }
-QSqlQuery DBManager::executeQuery(const QString& query)
+PooledQuery DBManager::executeQuery(const QString& query)
 {
-    QSqlQuery q;
+    ConnectionPool::Connection connection = pool->acquire();
+    const QSqlDatabase db = connection.database();
+    PooledQuery q(std::move(connection), QSqlQuery(db));
+    q.setForwardOnly(true);
 
     // Print the query string for debugging
-    qDebug() << "Executing Query:" << query;
+    SQL_TRACE << "Executing Query:" << query;
 
-    // Execute the query directly without preparing
+    // Execute the query directly without preparing, meant for one-off statements such as DDL
     if (!q.exec(query))
     {
         qDebug() << "Query execution error: " << q.lastError().text();
     } else {
-        qDebug() << "Query executed successfully.";
+        SQL_TRACE << "Query executed successfully.";
     }
 
     return q;
 }
 
-bool DBManager::addFlashcard(int deckId, const QString &frontName, const QString &backName) {
-    QString insertQuery = "INSERT INTO flashcards (deck_id, frontSide, backSide) VALUES (:deck_id, :question, :answer)";
-    QSqlQuery query;
-    query.prepare(insertQuery);
+void DBManager::logStats() const
+{
+    pool->logStats();
+}
+
+int DBManager::addFlashcard(int deckId, const QString &frontName, const QString &backName) {
+    // Returns the new card's id, -1 if the insert failed
+    QString insertQuery = "INSERT INTO flashcards (deck_id, frontSide, backSide) VALUES (:deck_id, :question, :answer) RETURNING id";
+    PooledQuery query = prepare(insertQuery);
     query.bindValue(":deck_id", deckId);
     query.bindValue(":question", frontName);
     query.bindValue(":answer", backName);
 
-    if (!query.exec()) {
+    if (!query.exec() || !query.next()) {
         qDebug() << "Failed to insert flashcard:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+bool DBManager::insertFlashcards(int deckId, const QVector<FlashcardRecord> &cards, QVector<int> *ids)
+{
+    if (cards.isEmpty()) {
+        return true;
+    }
+    // A full batch always has the same SQL, so its statement is prepared once and reused
+    QStringList rows;
+    rows.reserve(cards.size());
+    for (int i = 0; i < cards.size(); ++i) {
+        rows.append("(?, ?, ?)");
+    }
+    PooledQuery query = prepare("INSERT INTO flashcards (deck_id, frontSide, backSide) VALUES " + rows.join(", ") + " RETURNING id, frontSide, backSide");
+    int position = 0;
+    for (const FlashcardRecord &card : cards) {
+        query.bindValue(position++, deckId);
+        query.bindValue(position++, card.frontSide);
+        query.bindValue(position++, card.backSide);
+    }
+    if (!query.exec()) {
+        qDebug() << "Failed to insert flashcards:" << query.lastError().text();
+        return false;
+    }
+    if (!ids) {
+        return true;
+    }
+    // Neither backend promises RETURNING rows in the order of the VALUES list, so ids are matched
+    // to the cards by their text. Identical cards are interchangeable and take the ids in any order.
+    QHash<QPair<QString, QString>, QList<int>> positions;
+    for (int i = 0; i < cards.size(); ++i) {
+        positions[qMakePair(cards[i].frontSide, cards[i].backSide)].append(ids->size() + i);
+    }
+    const int first = ids->size();
+    ids->resize(first + cards.size());
+    int matched = 0;
+    while (query.next()) {
+        QList<int> &free = positions[qMakePair(query.value(1).toString(), query.value(2).toString())];
+        if (!free.isEmpty()) {
+            (*ids)[free.takeFirst()] = query.value(0).toInt();
+            matched++;
+        }
+    }
+    if (matched != cards.size()) {
+        qDebug() << "Inserted flashcards did not match the batch:" << matched << "of" << cards.size();
+        ids->resize(first);
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::beginTransaction()
+{
+    ConnectionPool::Connection connection = pool->acquire();
+    QSqlDatabase db = connection.database();
+    if (!db.transaction()) {
+        qDebug() << "Failed to start a transaction:" << db.lastError().text();
         return false;
     }
     return true;
 }
 
-QSqlQuery DBManager::fetchFlashcards(int deckId)
+bool DBManager::commitTransaction()
 {
-    // Fetch all flashcards for the given deckId from the database
-    QString selectQuery = "SELECT frontSide, backSide FROM flashcards WHERE deck_id = :deck_id";
-    QSqlQuery query;
-    query.prepare(selectQuery);
+    ConnectionPool::Connection connection = pool->acquire();
+    QSqlDatabase db = connection.database();
+    if (!db.commit()) {
+        qDebug() << "Failed to commit the transaction:" << db.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::rollbackTransaction()
+{
+    ConnectionPool::Connection connection = pool->acquire();
+    return connection.database().rollback();
+}
+
+PooledQuery DBManager::fetchFlashcards(int deckId)
+{
+    // Fetch all flashcards for the given deckId from the database, as a forward-only cursor
+    // that holds its connection until it is destroyed
+    QString selectQuery = "SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = :deck_id";
+    PooledQuery query = prepare(selectQuery);
     query.bindValue(":deck_id", deckId);
 
     if (!query.exec()) {
@@ -82,4 +350,409 @@ QSqlQuery DBManager::fetchFlashcards(int deckId)
     return query;
 }
 
+QVector<FlashcardRecord> DBManager::fetchFlashcardRecords(int deckId)
+{
+    // Same rows as fetchFlashcards, copied out of the query so they outlive the connection's thread
+    QVector<FlashcardRecord> records;
+    PooledQuery query = fetchFlashcards(deckId);
+    while (query.next()) {
+        FlashcardRecord record;
+        record.id = query.value(0).toInt();
+        record.frontSide = query.value(1).toString();
+        record.backSide = query.value(2).toString();
+        records.append(record);
+    }
+    return records;
+}
+
+QString DBManager::fetchBackSide(int cardId)
+{
+    // Card lists only carry the front side, the answer is read when it is shown
+    PooledQuery query = executeQuery("SELECT backSide FROM flashcards WHERE id = ?", QVariantList() << cardId);
+    if (!query.next()) {
+        return QString();
+    }
+    return query.value(0).toString();
+}
+
+qint64 DBManager::changeHorizon()
+{
+    // Postgres stamps rows with the writing transaction's id, every id below the oldest running one has finished.
+    // SQLite has one writer, whatever it has counted so far is committed or holds the write lock.
+    PooledQuery query = executeQuery(isSqlite()
+        ? "SELECT value + 1 FROM change_counter"
+        : "SELECT txid_snapshot_xmin(txid_current_snapshot())");
+    if (!query.next()) {
+        qDebug() << "Failed to read the change horizon:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toLongLong();
+}
+
+QPair<int, int> DBManager::fetchFlashcardIdRange(int deckId)
+{
+    // Both ends come from the (deck_id, id) index without touching the rows
+    PooledQuery query = executeQuery("SELECT min(id), max(id) FROM flashcards WHERE deck_id = ?", QVariantList() << deckId);
+    if (!query.next() || query.value(0).isNull()) {
+        return qMakePair(-1, -1);
+    }
+    return qMakePair(query.value(0).toInt(), query.value(1).toInt());
+}
+
+QVector<int> DBManager::fetchFlashcardIds(int deckId, int afterId, int limit)
+{
+    QVector<int> ids;
+    PooledQuery query = executeQuery("SELECT id FROM flashcards WHERE deck_id = ? AND id > ? ORDER BY id LIMIT ?",
+                                     QVariantList() << deckId << afterId << limit);
+    while (query.next()) {
+        ids.append(query.value(0).toInt());
+    }
+    return ids;
+}
+
+static QString intArray(const QVector<int> &values)
+{
+    QStringList items;
+    for (int value : values) {
+        items.append(QString::number(value));
+    }
+    return "{" + items.join(',') + "}";
+}
+
+QVector<FlashcardRecord> DBManager::fetchFlashcardsById(int deckId, const QVector<int> &ids)
+{
+    // One index probe per id, ids of other decks or of deleted cards find nothing
+    QVector<FlashcardRecord> records;
+    if (ids.isEmpty()) {
+        return records;
+    }
+    PooledQuery query;
+    if (isSqlite()) {
+        QStringList items;
+        for (int id : ids) {
+            items.append(QString::number(id));
+        }
+        query = executeQuery("SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? AND id IN (SELECT value FROM json_each(?))",
+                             QVariantList() << deckId << "[" + items.join(',') + "]");
+    } else {
+        query = executeQuery("SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? AND id = ANY(?::int[])", QVariantList() << deckId << intArray(ids));
+    }
+    if (query.lastError().type() != QSqlError::NoError) {
+        qDebug() << "Failed to fetch flashcards:" << query.lastError().text();
+        return records;
+    }
+    while (query.next()) {
+        FlashcardRecord record;
+        record.id = query.value(0).toInt();
+        record.frontSide = query.value(1).toString();
+        record.backSide = query.value(2).toString();
+        records.append(record);
+    }
+    return records;
+}
+
+QVector<FlashcardRecord> DBManager::sampleFlashcards(int deckId, int count, int minId, int maxId)
+{
+    // Every pivot takes the first card at or after it, wrapping around to the deck's first card,
+    // instead of ORDER BY random() which reads and sorts the whole deck
+    const QString sampleQuery = "SELECT f.id, f.frontSide, f.backSide FROM unnest(?::int[]) AS p(pivot) CROSS JOIN LATERAL ("
+                                "(SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? AND id >= p.pivot ORDER BY id LIMIT 1) "
+                                "UNION ALL "
+                                "(SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? ORDER BY id LIMIT 1) "
+                                "LIMIT 1) f";
+    QVector<FlashcardRecord> records;
+    if (count <= 0 || minId < 0 || maxId < minId) {
+        return records;
+    }
+    if (isSqlite()) {
+        return sampleFlashcardsSqlite(deckId, count, minId, maxId);
+    }
+    QSet<int> seenIds;
+    // Pivots landing on the same card are retried, a few rounds are enough unless the deck is nearly used up
+    for (int round = 0; round < 3 && records.size() < count; ++round) {
+        QVector<int> pivots;
+        for (int i = records.size(); i < count; ++i) {
+            pivots.append(int(QRandomGenerator::global()->bounded(qint64(minId), qint64(maxId) + 1)));
+        }
+        PooledQuery query = executeQuery(sampleQuery, QVariantList() << intArray(pivots) << deckId << deckId);
+        if (query.lastError().type() != QSqlError::NoError) {
+            break;
+        }
+        bool found = false;
+        while (query.next()) {
+            const int id = query.value(0).toInt();
+            if (seenIds.contains(id)) {
+                continue;
+            }
+            FlashcardRecord record;
+            record.id = id;
+            record.frontSide = query.value(1).toString();
+            record.backSide = query.value(2).toString();
+            records.append(record);
+            seenIds.insert(id);
+            found = true;
+        }
+        if (!found) {
+            break;
+        }
+    }
+    return records;
+}
+
+QVector<FlashcardRecord> DBManager::sampleFlashcardsSqlite(int deckId, int count, int minId, int maxId)
+{
+    // SQLite has no LATERAL join, but a query is a function call on the same thread rather than a
+    // round-trip, so each pivot gets its own index probe
+    const QString atOrAfter = "SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? AND id >= ? ORDER BY id LIMIT 1";
+    const QString first = "SELECT id, frontSide, backSide FROM flashcards WHERE deck_id = ? ORDER BY id LIMIT 1";
+    QVector<FlashcardRecord> records;
+    QSet<int> seenIds;
+    // A pivot landing on a card already drawn is retried, a few misses in a row mean the deck is smaller than count
+    int misses = 0;
+    while (records.size() < count && misses < 3) {
+        const int pivot = int(QRandomGenerator::global()->bounded(qint64(minId), qint64(maxId) + 1));
+        PooledQuery query = executeQuery(atOrAfter, QVariantList() << deckId << pivot);
+        if (!query.next()) {
+            query = executeQuery(first, QVariantList() << deckId);
+            if (!query.next()) {
+                break;
+            }
+        }
+        const int id = query.value(0).toInt();
+        if (seenIds.contains(id)) {
+            misses++;
+            continue;
+        }
+        FlashcardRecord record;
+        record.id = id;
+        record.frontSide = query.value(1).toString();
+        record.backSide = query.value(2).toString();
+        records.append(record);
+        seenIds.insert(id);
+        misses = 0;
+    }
+    return records;
+}
+
+QVector<ReviewState> DBManager::fetchDueCards(int deckId, const QDateTime &afterDue, int afterCardId, int limit)
+{
+    // Keyset pagination on (due, card_id), every page is a range scan of one of the due indexes.
+    // due is stored in milliseconds on both backends, the precision of the QDateTime cursor.
+    QVector<ReviewState> states;
+    const QString columns = "SELECT card_id, deck_id, due, interval_days, ease, repetitions, lapses FROM review_state WHERE ";
+    PooledQuery query = deckId == -1
+        ? executeQuery(columns + "(due, card_id) > (?, ?) ORDER BY due, card_id LIMIT ?", QVariantList() << timestampValue(afterDue) << afterCardId << limit)
+        : executeQuery(columns + "deck_id = ? AND (due, card_id) > (?, ?) ORDER BY due, card_id LIMIT ?", QVariantList() << deckId << timestampValue(afterDue) << afterCardId << limit);
+    while (query.next()) {
+        ReviewState state;
+        state.cardId = query.value(0).toInt();
+        state.deckId = query.value(1).toInt();
+        state.due = toDateTime(query.value(2));
+        state.intervalDays = query.value(3).toDouble();
+        state.ease = query.value(4).toDouble();
+        state.repetitions = query.value(5).toInt();
+        state.lapses = query.value(6).toInt();
+        states.append(state);
+    }
+    return states;
+}
+
+bool DBManager::updateReviewState(const ReviewState &state)
+{
+    PooledQuery query = executeQuery("UPDATE review_state SET due = ?, interval_days = ?, ease = ?, repetitions = ?, lapses = ? WHERE card_id = ?",
+                                   QVariantList() << timestampValue(state.due) << state.intervalDays << state.ease << state.repetitions << state.lapses << state.cardId);
+    if (query.lastError().type() != QSqlError::NoError) {
+        qDebug() << "Failed to save review state:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool DBManager::updateReviewStates(const QVector<ReviewState> &states)
+{
+    if (states.isEmpty()) {
+        return true;
+    }
+    if (isSqlite()) {
+        // No round-trips to save on an embedded database, callers batch these inside a transaction
+        for (const ReviewState &state : states) {
+            if (!updateReviewState(state)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    QStringList rows;
+    QVariantList values;
+    for (const ReviewState &state : states) {
+        rows.append("(?::int, ?::timestamptz, ?::float8, ?::float8, ?::int, ?::int)");
+        values << state.cardId << state.due << state.intervalDays << state.ease << state.repetitions << state.lapses;
+    }
+    PooledQuery query = executeQuery("UPDATE review_state r SET due = v.due, interval_days = v.interval_days, ease = v.ease, repetitions = v.repetitions, lapses = v.lapses "
+                                   "FROM (VALUES " + rows.join(", ") + ") AS v(card_id, due, interval_days, ease, repetitions, lapses) WHERE r.card_id = v.card_id", values);
+    if (query.lastError().type() != QSqlError::NoError) {
+        qDebug() << "Failed to restore review state:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QVector<SearchHit> DBManager::searchFlashcards(const QString &tsQuery, double afterRank, int afterCardId, int limit, QSqlError *error)
+{
+    // The match uses flashcards_search_idx and every match is ranked, so pages come from one fixed order.
+    // A prefix broad enough to make that slow runs into the search connection's statement timeout.
+    // Front side words weigh more.
+    QVector<SearchHit> hits;
+    PooledQuery query = executeQuery("SELECT id, deck_id, frontSide, backSide, rank FROM ("
+                                   "SELECT f.id, f.deck_id, f.frontSide, f.backSide, "
+                                   "ts_rank(setweight(to_tsvector('simple', f.frontSide), 'A') || setweight(to_tsvector('simple', f.backSide), 'B'), q)::float8 AS rank "
+                                   "FROM flashcards f, to_tsquery('simple', ?) q "
+                                   "WHERE to_tsvector('simple', f.frontSide || ' ' || f.backSide) @@ q) s "
+                                   "WHERE rank < ? OR (rank = ? AND id > ?) ORDER BY rank DESC, id LIMIT ?",
+                                   QVariantList() << tsQuery << afterRank << afterRank << afterCardId << limit);
+    if (query.lastError().type() != QSqlError::NoError) {
+        qDebug() << "Failed to search flashcards:" << query.lastError().text();
+        if (error) {
+            *error = query.lastError();
+        }
+        return hits;
+    }
+    while (query.next()) {
+        SearchHit hit;
+        hit.cardId = query.value(0).toInt();
+        hit.deckId = query.value(1).toInt();
+        hit.frontSide = query.value(2).toString();
+        hit.backSide = query.value(3).toString();
+        hit.rank = query.value(4).toDouble();
+        hits.append(hit);
+    }
+    return hits;
+}
+
+bool DBManager::trimExerciseCache(int maxRows)
+{
+    // Keep the table bounded by dropping the oldest sentences
+    PooledQuery query = executeQuery("DELETE FROM exercise_cache WHERE id IN (SELECT id FROM exercise_cache ORDER BY created_at, id LIMIT "
+                                   "(SELECT CASE WHEN count(*) > ? THEN count(*) - ? ELSE 0 END FROM exercise_cache))", QVariantList() << maxRows << maxRows);
+    return query.lastError().type() == QSqlError::NoError;
+}
+
+QString DBManager::fetchCachedExercise(int cardId, const QString &promptHash, const QString &model, const QString &cardHash)
+{
+    // Round-robin: serve the least served sentence and bump its counter in the same round-trip
+    PooledQuery query = prepare("UPDATE exercise_cache SET served_count = served_count + 1 WHERE id = ("
+                                "SELECT id FROM exercise_cache WHERE card_id = :card_id AND prompt_hash = :prompt_hash AND model = :model AND card_hash = :card_hash "
+                                "ORDER BY served_count, id LIMIT 1) RETURNING sentence");
+    query.bindValue(":card_id", cardId);
+    query.bindValue(":prompt_hash", promptHash);
+    query.bindValue(":model", model);
+    query.bindValue(":card_hash", cardHash);
+
+    if (!query.exec()) {
+        qDebug() << "Failed to read exercise cache:" << query.lastError().text();
+        return QString();
+    }
+    if (!query.next()) {
+        return QString();
+    }
+    return query.value(0).toString();
+}
+
+int DBManager::countCachedExercises(int cardId, const QString &promptHash, const QString &model, const QString &cardHash)
+{
+    PooledQuery query = prepare("SELECT count(*) FROM exercise_cache WHERE card_id = :card_id AND prompt_hash = :prompt_hash AND model = :model AND card_hash = :card_hash");
+    query.bindValue(":card_id", cardId);
+    query.bindValue(":prompt_hash", promptHash);
+    query.bindValue(":model", model);
+    query.bindValue(":card_hash", cardHash);
+
+    if (!query.exec() || !query.next()) {
+        qDebug() << "Failed to count cached exercises:" << query.lastError().text();
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+bool DBManager::addCachedExercise(int cardId, const QString &promptHash, const QString &model, const QString &cardHash, const QString &sentence, int perCardLimit)
+{
+    // Sentences generated for an older text of the card are stale
+    PooledQuery query = prepare("DELETE FROM exercise_cache WHERE card_id = :card_id AND card_hash <> :card_hash");
+    query.bindValue(":card_id", cardId);
+    query.bindValue(":card_hash", cardHash);
+    if (!query.exec()) {
+        qDebug() << "Failed to invalidate cached exercises:" << query.lastError().text();
+        return false;
+    }
+
+    query = prepare("INSERT INTO exercise_cache (card_id, prompt_hash, model, card_hash, sentence) VALUES (:card_id, :prompt_hash, :model, :card_hash, :sentence)");
+    query.bindValue(":card_id", cardId);
+    query.bindValue(":prompt_hash", promptHash);
+    query.bindValue(":model", model);
+    query.bindValue(":card_hash", cardHash);
+    query.bindValue(":sentence", sentence);
+    if (!query.exec()) {
+        qDebug() << "Failed to cache exercise:" << query.lastError().text();
+        return false;
+    }
+
+    // Only the newest sentences per card are kept
+    query = prepare("DELETE FROM exercise_cache WHERE card_id = ? AND prompt_hash = ? AND model = ? AND id NOT IN ("
+                    "SELECT id FROM exercise_cache WHERE card_id = ? AND prompt_hash = ? AND model = ? ORDER BY id DESC LIMIT ?)");
+    for (int i = 0; i < 2; ++i)
+    {
+        query.bindValue(i * 3, cardId);
+        query.bindValue(i * 3 + 1, promptHash);
+        query.bindValue(i * 3 + 2, model);
+    }
+    query.bindValue(6, perCardLimit);
+    if (!query.exec()) {
+        qDebug() << "Failed to trim exercise cache:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
 
+bool DBManager::invalidateCachedExercises(int cardId)
+{
+    PooledQuery query = executeQuery("DELETE FROM exercise_cache WHERE card_id = ?", QVariantList() << cardId);
+    return query.lastError().type() == QSqlError::NoError;
+}
+
+bool DBManager::insertCachedExercises(const QVector<CachedExercise> &exercises)
+{
+    if (exercises.isEmpty()) {
+        return true;
+    }
+    QStringList rows;
+    QVariantList values;
+    for (const CachedExercise &exercise : exercises) {
+        rows.append("(?, ?, ?, ?, ?)");
+        values << exercise.cardId << exercise.promptHash << exercise.model << exercise.cardHash << exercise.sentence;
+    }
+    PooledQuery query = executeQuery("INSERT INTO exercise_cache (card_id, prompt_hash, model, card_hash, sentence) VALUES " + rows.join(", "), values);
+    if (query.lastError().type() != QSqlError::NoError) {
+        qDebug() << "Failed to restore cached exercises:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QHash<int, QString> DBManager::fetchCachedCardHashes(int deckId, const QString &promptHash, const QString &model)
+{
+    // Card hashes the deck's cached sentences were generated for, used to find cards that still need one
+    QHash<int, QString> hashes;
+    PooledQuery query = prepare("SELECT DISTINCT c.card_id, c.card_hash FROM exercise_cache c JOIN flashcards f ON f.id = c.card_id "
+                                "WHERE f.deck_id = :deck_id AND c.prompt_hash = :prompt_hash AND c.model = :model");
+    query.bindValue(":deck_id", deckId);
+    query.bindValue(":prompt_hash", promptHash);
+    query.bindValue(":model", model);
+
+    if (!query.exec()) {
+        qDebug() << "Failed to read cached card hashes:" << query.lastError().text();
+        return hashes;
+    }
+    while (query.next()) {
+        hashes.insert(query.value(0).toInt(), query.value(1).toString());
+    }
+    return hashes;
+}
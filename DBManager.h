@@ -4,24 +4,150 @@
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
+#include <QtSql/QSqlDriver>
+#include <QStringList>
 #include <QString>
 #include <QDebug>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QSharedPointer>
+#include <QDateTime>
+#include "ConnectionPool.h"
+
+// One flashcard row, a plain value that can be handed between threads
+struct FlashcardRecord
+{
+    int id = -1;
+    QString frontSide;
+    QString backSide;
+};
+
+// Spaced-repetition state of one card, cards never reviewed are due from the moment they were added
+struct ReviewState
+{
+    int cardId = -1;
+    int deckId = -1;
+    QDateTime due;
+    double intervalDays = 0;
+    double ease = 2.5;
+    int repetitions = 0;
+    int lapses = 0;
+};
+
+// A generated exercise sentence as stored in exercise_cache
+struct CachedExercise
+{
+    int cardId = -1;
+    QString promptHash;
+    QString model;
+    QString cardHash;
+    QString sentence;
+};
+
+// A card matching a search, rank is higher for better matches and only comparable within one backend
+struct SearchHit
+{
+    int cardId = -1;
+    int deckId = -1;
+    QString frontSide;
+    QString backSide;
+    double rank = 0;
+};
+
+// Where the data lives: the shared Postgres server or an SQLite file on this machine.
+// Both have the same schema; the queries below pick the dialect where the two differ.
+enum class StorageBackend
+{
+    Postgres,
+    Sqlite
+};
 
 class DBManager
 {
 public:
-    DBManager(const QString& host, const QString& dbName, const QString& user, int port);
+    // Copies share the connection pool, each thread that uses one gets its own connection
+    DBManager(const QString& host, const QString& dbName, const QString& user, int port, int poolSize = 4);
+    // Embedded database in the file at path, created on first use
+    static DBManager sqlite(const QString &path, int poolSize = 4);
+    StorageBackend backend() const;
+    bool isSqlite() const;
+    // A time as bound to this backend's timestamp columns; SQLite stores UTC ISO 8601 text that sorts in time order
+    QVariant timestampValue(const QDateTime &time) const;
+    // Reads a timestamp column of either backend
+    static QDateTime toDateTime(const QVariant &value);
+    void setPoolSize(int poolSize);
     bool connect();
-    QSqlQuery executeQuery(const QString& query);
-    QSqlQuery executeQuery(const QString& query, const QVariantList& values);
-    bool addFlashcard(int deckId, const QString &frontName, const QString &backName);
-    QSqlQuery fetchFlashcards(int deckId);
+    // Closes the calling thread's connection
+    void close();
+    // Brings the schema up to date with SchemaMigrations in one transaction, run once at startup
+    bool migrate();
+    // LISTEN on channel with the calling thread's connection
+    bool subscribe(const QString &channel);
+    // Driver of the calling thread's connection, emits the notifications subscribed to
+    QSqlDriver *driver();
+    QVector<QPair<int, QString>> fetchDecks();
+    // Up to limit decks with an id greater than afterId, in id order
+    QVector<QPair<int, QString>> fetchDecksPage(int afterId, int limit);
+    int addDeck(const QString &name);
+    bool removeDeck(int deckId);
+    PooledQuery executeQuery(const QString& query);
+    // Prepared statements are cached per connection, the returned query is forward-only,
+    // keeps the connection checked out while it exists and its rows stay valid while
+    // the same SQL runs again on this thread
+    PooledQuery executeQuery(const QString& query, const QVariantList& values);
+    // Returns the new card's id, -1 if the insert failed
+    int addFlashcard(int deckId, const QString &frontName, const QString &backName);
+    // Inserts the cards with one multi-row INSERT, ids of the records are ignored.
+    // The new ids are appended to ids in the order of cards.
+    bool insertFlashcards(int deckId, const QVector<FlashcardRecord> &cards, QVector<int> *ids = nullptr);
+    // Transaction on the calling thread's connection
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
+    PooledQuery fetchFlashcards(int deckId);
+    QVector<FlashcardRecord> fetchFlashcardRecords(int deckId);
+    // Null if the card does not exist
+    QString fetchBackSide(int cardId);
+    // Rows with a change_seq below this are committed and no later commit gets one, readers paging
+    // on (change_seq, uid) stop here. -1 on failure.
+    qint64 changeHorizon();
+    // Smallest and largest card id of the deck, (-1, -1) if the deck has no cards
+    QPair<int, int> fetchFlashcardIdRange(int deckId);
+    // Up to limit card ids of the deck after afterId, in id order, read from the (deck_id, id) index
+    QVector<int> fetchFlashcardIds(int deckId, int afterId, int limit);
+    // Up to count distinct random cards of the deck whose ids lie in [minId, maxId].
+    // Each card is one index probe at a random id, so the cost grows with count and not with the deck size.
+    // Cards after a gap in the ids are picked more often than others.
+    QVector<FlashcardRecord> sampleFlashcards(int deckId, int count, int minId, int maxId);
+    // The cards of the deck among ids, in no particular order
+    QVector<FlashcardRecord> fetchFlashcardsById(int deckId, const QVector<int> &ids);
+    // Up to limit cards in due order after the (due, card id) position given, deckId -1 for every deck
+    QVector<ReviewState> fetchDueCards(int deckId, const QDateTime &afterDue, int afterCardId, int limit);
+    bool updateReviewState(const ReviewState &state);
+    // Same as updateReviewState for many cards in one statement
+    bool updateReviewStates(const QVector<ReviewState> &states);
+    // Cards of every deck matching the full-text query, best first, after the (rank, card id) position given.
+    // Only the first thousand matches are ranked. Postgres only, tsQuery is in to_tsquery syntax.
+    QVector<SearchHit> searchFlashcards(const QString &tsQuery, double afterRank, int afterCardId, int limit, QSqlError *error = nullptr);
+    // Drops the oldest sentences beyond maxRows
+    bool trimExerciseCache(int maxRows);
+    QString fetchCachedExercise(int cardId, const QString &promptHash, const QString &model, const QString &cardHash);
+    int countCachedExercises(int cardId, const QString &promptHash, const QString &model, const QString &cardHash);
+    bool addCachedExercise(int cardId, const QString &promptHash, const QString &model, const QString &cardHash, const QString &sentence, int perCardLimit);
+    bool invalidateCachedExercises(int cardId);
+    // Restores exported sentences with one multi-row INSERT
+    bool insertCachedExercises(const QVector<CachedExercise> &exercises);
+    QHash<int, QString> fetchCachedCardHashes(int deckId, const QString &promptHash, const QString &model);
+    void logStats() const;
 private:
-    QSqlDatabase db;
-    QString dbHost;
-    QString dbName;
-    QString dbUser;
-    int dbPort;
+    DBManager(const QSharedPointer<ConnectionPool> &pool, StorageBackend backend);
+    QVector<FlashcardRecord> sampleFlashcardsSqlite(int deckId, int count, int minId, int maxId);
+    // The connection's cached statement for sql, checked out for as long as the query lives
+    PooledQuery prepare(const QString &sql);
+
+    QSharedPointer<ConnectionPool> pool;
+    StorageBackend storage = StorageBackend::Postgres;
 };
 
 #endif // DBMANAGER_H
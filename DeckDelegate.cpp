@@ -0,0 +1,51 @@
+#include "DeckDelegate.h"
+
+#include <QPainter>
+#include <QPen>
+
+// Same look as the old per-deck style sheet
+static const QColor backgroundColor("#2e2e2e");
+static const QColor hoverBackgroundColor("#1e1e1e");
+static const QColor textColor("#f0f0f0");
+static const QColor hoverTextColor("#c0c0c0");
+static const QColor borderColor("#8f8f91");
+static const int borderWidth = 2;
+static const int borderRadius = 10;
+static const int padding = 10;
+
+DeckDelegate::DeckDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+    font.setBold(true);
+    font.setPixelSize(14);
+}
+
+QSize DeckDelegate::tileSize()
+{
+    return QSize(180, 120);
+}
+
+void DeckDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const bool hovered = option.state & QStyle::State_MouseOver;
+    const qreal inset = borderWidth / 2.0;
+    const QRectF tile = QRectF(option.rect).adjusted(inset, inset, -inset, -inset);
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(QPen(borderColor, borderWidth));
+    painter->setBrush(hovered ? hoverBackgroundColor : backgroundColor);
+    painter->drawRoundedRect(tile, borderRadius, borderRadius);
+
+    painter->setFont(font);
+    painter->setPen(hovered ? hoverTextColor : textColor);
+    const QRect textRect = option.rect.adjusted(padding, padding, -padding, -padding);
+    const QString name = painter->fontMetrics().elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textRect.width() * 3);
+    painter->drawText(textRect, Qt::AlignCenter | Qt::TextWordWrap, name);
+    painter->restore();
+}
+
+QSize DeckDelegate::sizeHint(const QStyleOptionViewItem &, const QModelIndex &) const
+{
+    return tileSize();
+}
@@ -0,0 +1,27 @@
+#ifndef DECKDELEGATE_H
+#define DECKDELEGATE_H
+
+#include <QColor>
+#include <QFont>
+#include <QSize>
+#include <QStyledItemDelegate>
+
+// Paints a deck tile: the dark rounded panel the decks always had, drawn
+// directly instead of through a style sheet on a widget per deck.
+class DeckDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit DeckDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    static QSize tileSize();
+
+private:
+    QFont font;
+};
+
+#endif // DECKDELEGATE_H
@@ -0,0 +1,152 @@
+#include "DeckModel.h"
+
+DeckModel::DeckModel(QObject *parent)
+    : QAbstractListModel(parent) {}
+
+int DeckModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : decks.size();
+}
+
+QVariant DeckModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= decks.size()) {
+        return QVariant();
+    }
+    const auto &deck = decks.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return deck.second;
+    case DeckIdRole:
+        return deck.first;
+    default:
+        return QVariant();
+    }
+}
+
+void DeckModel::setPageLoader(PageLoader loader, int pageSize)
+{
+    pageLoader = loader;
+    decksPerPage = qMax(1, pageSize);
+}
+
+int DeckModel::pageSize() const
+{
+    return decksPerPage;
+}
+
+bool DeckModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && pageLoader && !loading && !exhausted;
+}
+
+void DeckModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent)) {
+        return;
+    }
+    loading = true;
+    const int requested = generation;
+    pageLoader(lastId, decksPerPage, [this, requested](const QVector<QPair<int, QString>> &page) {
+        // A page requested before a reload belongs to the old contents
+        if (requested == generation) {
+            appendPage(page);
+        }
+    });
+}
+
+void DeckModel::setDecks(const QVector<QPair<int, QString>> &newDecks)
+{
+    clear();
+    appendPage(newDecks);
+}
+
+void DeckModel::clear()
+{
+    beginResetModel();
+    generation++;
+    decks.clear();
+    rowById.clear();
+    lastId = 0;
+    loading = false;
+    exhausted = false;
+    endResetModel();
+}
+
+void DeckModel::appendPage(const QVector<QPair<int, QString>> &page)
+{
+    loading = false;
+    exhausted = page.size() < decksPerPage;
+    QVector<QPair<int, QString>> fresh;
+    for (const auto &deck : page) {
+        lastId = qMax(lastId, deck.first);
+        if (!rowById.contains(deck.first)) {
+            fresh.append(deck);
+        }
+    }
+    if (fresh.isEmpty()) {
+        return;
+    }
+    const int first = decks.size();
+    beginInsertRows(QModelIndex(), first, first + fresh.size() - 1);
+    decks += fresh;
+    reindexFrom(first);
+    endInsertRows();
+}
+
+void DeckModel::addDeck(int deckId, const QString &name)
+{
+    // Ids only grow, so a new deck belongs after every loaded page
+    if (rowById.contains(deckId) || !exhausted) {
+        return;
+    }
+    const int row = decks.size();
+    beginInsertRows(QModelIndex(), row, row);
+    decks.append(qMakePair(deckId, name));
+    rowById.insert(deckId, row);
+    lastId = qMax(lastId, deckId);
+    endInsertRows();
+}
+
+void DeckModel::removeDeck(int deckId)
+{
+    const int row = rowForId(deckId);
+    if (row < 0) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), row, row);
+    decks.remove(row);
+    rowById.remove(deckId);
+    // Rows after the removed one moved up by one
+    reindexFrom(row);
+    endRemoveRows();
+}
+
+void DeckModel::renameDeck(int deckId, const QString &name)
+{
+    const int row = rowForId(deckId);
+    if (row < 0 || decks.at(row).second == name) {
+        return;
+    }
+    decks[row].second = name;
+    const QModelIndex changed = index(row);
+    emit dataChanged(changed, changed);
+}
+
+int DeckModel::deckId(const QModelIndex &index) const
+{
+    return index.isValid() ? data(index, DeckIdRole).toInt() : -1;
+}
+
+int DeckModel::rowForId(int deckId) const
+{
+    return rowById.value(deckId, -1);
+}
+
+void DeckModel::reindexFrom(int row)
+{
+    for (int i = row; i < decks.size(); ++i) {
+        rowById.insert(decks.at(i).first, i);
+    }
+}
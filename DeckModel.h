@@ -0,0 +1,62 @@
+#ifndef DECKMODEL_H
+#define DECKMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+// Deck ids and names for the deck grid. The view only asks for the rows it
+// paints, and rowForId keeps a hash so a deck can be found without a scan.
+// Decks are loaded in pages ordered by id: views call fetchMore when they
+// are scrolled to the end and the page loader asks for the decks after the
+// last id already loaded.
+class DeckModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles { DeckIdRole = Qt::UserRole + 1 };
+
+    // Loads up to limit decks with an id greater than afterId and passes them to onPage
+    using PageLoader = std::function<void(int afterId, int limit, std::function<void(const QVector<QPair<int, QString>> &page)> onPage)>;
+
+    explicit DeckModel(QObject *parent = nullptr);
+    void setPageLoader(PageLoader pageLoader, int pageSize);
+    int pageSize() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    // Replaces the contents with an already loaded first page
+    void setDecks(const QVector<QPair<int, QString>> &decks);
+    // A deck past the loaded pages shows up when its page is fetched
+    void addDeck(int deckId, const QString &name);
+    void removeDeck(int deckId);
+    void renameDeck(int deckId, const QString &name);
+
+    int deckId(const QModelIndex &index) const;
+    // -1 if the deck is not in the model
+    int rowForId(int deckId) const;
+
+private:
+    void clear();
+    void reindexFrom(int row);
+    void appendPage(const QVector<QPair<int, QString>> &page);
+
+    QVector<QPair<int, QString>> decks;
+    QHash<int, int> rowById;
+    PageLoader pageLoader;
+    int decksPerPage = 100;
+    int lastId = 0;
+    int generation = 0;
+    bool loading = false;
+    bool exhausted = false;
+};
+
+#endif // DECKMODEL_H
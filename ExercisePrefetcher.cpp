@@ -0,0 +1,404 @@
+#include "ExercisePrefetcher.h"
+
+#include <QCryptographicHash>
+#include <QHash>
+#include <QDebug>
+
+ExercisePrefetcher::ExercisePrefetcher(AsyncDBManager *asyncDb, Generator generator, QObject *parent)
+    : QObject(parent), asyncDb(asyncDb), generator(std::move(generator)) {}
+
+void ExercisePrefetcher::setWithoutReplacement(bool enabled)
+{
+    withoutReplacement = enabled;
+    samplers.clear();
+}
+
+QSharedPointer<CardSampler> ExercisePrefetcher::sampler(int deckId)
+{
+    QSharedPointer<CardSampler> &deckSampler = samplers[deckId];
+    if (!deckSampler)
+    {
+        deckSampler = QSharedPointer<CardSampler>::create(deckId, withoutReplacement);
+    }
+    return deckSampler;
+}
+
+void ExercisePrefetcher::setStreamGenerator(StreamGenerator streamGenerator)
+{
+    this->streamGenerator = std::move(streamGenerator);
+}
+
+void ExercisePrefetcher::setBatchGenerator(BatchGenerator batchGenerator, int batchSize)
+{
+    this->batchGenerator = std::move(batchGenerator);
+    this->batchSize = qMax(1, batchSize);
+}
+
+void ExercisePrefetcher::setDepth(int depth)
+{
+    prefetchDepth = qMax(1, depth);
+}
+
+int ExercisePrefetcher::depth() const
+{
+    return prefetchDepth;
+}
+
+void ExercisePrefetcher::setCacheKey(const QString &model, const QString &promptTemplate)
+{
+    this->model = model;
+    promptHash = QString::fromLatin1(QCryptographicHash::hash(promptTemplate.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+void ExercisePrefetcher::setCacheLimit(int sentencesPerCard)
+{
+    cachePerCard = qMax(1, sentencesPerCard);
+}
+
+void ExercisePrefetcher::setRegenerate(bool enabled)
+{
+    regenerate = enabled;
+}
+
+void ExercisePrefetcher::start(int deckId)
+{
+    // "Next Exercise" opens the view again for the same deck, only a new session starts a new round
+    if (deckId != activeDeckId)
+    {
+        sampler(deckId)->reset();
+        activeDeckId = deckId;
+    }
+    refill();
+}
+
+void ExercisePrefetcher::stop()
+{
+    if (activeDeckId != -1)
+    {
+        logStats();
+    }
+    // Requests already sent still land in their deck's queue, nothing new is started
+    activeDeckId = -1;
+    waiter = nullptr;
+    waiterContext = nullptr;
+}
+
+void ExercisePrefetcher::invalidateDeck(int deckId)
+{
+    if (samplers.contains(deckId))
+    {
+        samplers[deckId]->invalidate();
+    }
+    if (deckId == activeDeckId)
+    {
+        refill();
+    }
+}
+
+static Exercise toExercise(const FlashcardRecord &card)
+{
+    Exercise exercise;
+    exercise.cardId = card.id;
+    exercise.frontSide = card.frontSide;
+    exercise.backSide = card.backSide;
+    return exercise;
+}
+
+void ExercisePrefetcher::pregenerate(int deckId, QObject *context, std::function<void(int missing)> onStarted)
+{
+    if (!batchGenerator)
+    {
+        onStarted(0);
+        return;
+    }
+    // Every card is hashed, so the worker reads the whole deck with its back sides in one query
+    const QString promptHash = this->promptHash;
+    const QString model = this->model;
+    QPointer<QObject> guard(context);
+    asyncDb->run([deckId, promptHash, model](DBManager &db) {
+        return qMakePair(db.fetchFlashcardRecords(deckId), db.fetchCachedCardHashes(deckId, promptHash, model));
+    }, this, [this, deckId, guard, onStarted](const QPair<QVector<FlashcardRecord>, QHash<int, QString>> &deck) {
+        QVector<Exercise> missing;
+        for (const FlashcardRecord &record : deck.first)
+        {
+            const Exercise card = toExercise(record);
+            if (deck.second.value(card.cardId) != cardHash(card))
+            {
+                missing.append(card);
+            }
+        }
+        if (!missing.isEmpty())
+        {
+            submitBatch(deckId, missing, 0, missing.size());
+        }
+        if (guard)
+        {
+            onStarted(missing.size());
+        }
+    });
+}
+
+void ExercisePrefetcher::submitBatch(int deckId, QVector<Exercise> cards, int done, int total)
+{
+    // One slice in flight at a time so a huge deck doesn't flood the server
+    const QVector<Exercise> slice = cards.mid(done, batchSize);
+    QHash<int, Exercise> byId;
+    for (const Exercise &card : slice)
+    {
+        byId.insert(card.cardId, card);
+    }
+    // The slice's sentences are written together once it finished, not one insert per card
+    QSharedPointer<QVector<QPair<Exercise, QString>>> results = QSharedPointer<QVector<QPair<Exercise, QString>>>::create();
+    batchGenerator(slice, [byId, results](int cardId, const QString &sentence) {
+        if (!byId.contains(cardId) || sentence.isEmpty())
+        {
+            return;
+        }
+        results->append(qMakePair(byId.value(cardId), sentence));
+    }, [this, deckId, cards, done, total, results]() {
+        storeSentences(*results);
+        const int nextDone = qMin(done + batchSize, total);
+        emit pregenerateProgress(deckId, nextDone, total);
+        if (nextDone < total)
+        {
+            submitBatch(deckId, cards, nextDone, total);
+        }
+    });
+}
+
+void ExercisePrefetcher::storeSentences(const QVector<QPair<Exercise, QString>> &sentences)
+{
+    if (sentences.isEmpty())
+    {
+        return;
+    }
+    const QString promptHash = this->promptHash;
+    const QString model = this->model;
+    const int perCard = cachePerCard;
+    asyncDb->run([sentences, promptHash, model, perCard](DBManager &db) {
+        const bool transaction = db.beginTransaction();
+        bool ok = true;
+        for (const auto &entry : sentences)
+        {
+            ok = db.addCachedExercise(entry.first.cardId, promptHash, model, cardHash(entry.first), entry.second, perCard) && ok;
+        }
+        if (transaction && !db.commitTransaction())
+        {
+            qDebug() << "Failed to commit cached exercises";
+            ok = false;
+        }
+        return ok;
+    }, this, [](bool) {});
+}
+
+QString ExercisePrefetcher::cardHash(const Exercise &card)
+{
+    const QByteArray text = (card.frontSide + '\n' + card.backSide).toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(text, QCryptographicHash::Sha1).toHex());
+}
+
+bool ExercisePrefetcher::requestExercise(QObject *context, std::function<void(const Exercise &exercise)> onReady, std::function<void(const QString &partial)> onPartial)
+{
+    QQueue<Exercise> &queue = queues[activeDeckId];
+    if (!queue.isEmpty())
+    {
+        hitCount++;
+        const Exercise exercise = queue.dequeue();
+        // The view gets its exercise first, topping the queue up again goes to the database worker
+        onReady(exercise);
+        refill();
+        return true;
+    }
+    missCount++;
+    // Only the visible view waits, a newer request replaces the old one. A warm cache
+    // serves it from the refill without waiting for the LLM.
+    waiterContext = context;
+    waiter = std::move(onReady);
+    const int request = ++waiterRequest;
+    refill();
+    if (!streamGenerator || !onPartial || activeDeckId == -1)
+    {
+        return false;
+    }
+    // Stream a fresh exercise for the view unless the refill served it first, the queue keeps refilling behind it
+    QSharedPointer<CardSampler> cards = sampler(activeDeckId);
+    asyncDb->run([cards](DBManager &db) {
+        return cards->sample(db, 1);
+    }, context, [this, request, onPartial](const QVector<FlashcardRecord> &drawn) {
+        if (drawn.isEmpty() || request != waiterRequest || !waiter || !waiterContext)
+        {
+            return;
+        }
+        auto onReady = std::move(waiter);
+        QPointer<QObject> guard = waiterContext;
+        waiter = nullptr;
+        waiterContext = nullptr;
+        const Exercise card = toExercise(drawn.first());
+        streamGenerator(card.frontSide, card.backSide, guard, [guard, onPartial](const QString &partial) {
+            if (guard)
+            {
+                onPartial(partial);
+            }
+        }, [this, guard, card, onReady](const QString &sentence) {
+            if (sentence.isEmpty())
+            {
+                return;
+            }
+            storeSentences({qMakePair(card, sentence)});
+            if (guard)
+            {
+                Exercise exercise = card;
+                exercise.sentence = sentence;
+                onReady(exercise);
+            }
+        });
+    });
+    return false;
+}
+
+namespace {
+// A card drawn by a refill job with its cached sentence, empty if it has none
+struct DrawnCard
+{
+    Exercise exercise;
+    // Cached, but with fewer sentences than the cache keeps per card
+    bool topUp = false;
+};
+}
+
+void ExercisePrefetcher::refill()
+{
+    if (activeDeckId == -1 || refilling.contains(activeDeckId))
+    {
+        return;
+    }
+    const int deckId = activeDeckId;
+    const int needed = prefetchDepth - queues[deckId].size() - inFlight[deckId];
+    if (needed <= 0)
+    {
+        return;
+    }
+    refilling.insert(deckId);
+    QSharedPointer<CardSampler> cards = sampler(deckId);
+    const QString promptHash = this->promptHash;
+    const QString model = this->model;
+    const bool topUp = regenerate;
+    const int perCard = cachePerCard;
+    // One job draws every card the queue is short of and reads their cached sentences
+    asyncDb->run([cards, needed, promptHash, model, topUp, perCard](DBManager &db) {
+        QVector<DrawnCard> drawn;
+        for (const FlashcardRecord &card : cards->sample(db, needed))
+        {
+            DrawnCard entry;
+            entry.exercise = toExercise(card);
+            const QString hash = cardHash(entry.exercise);
+            entry.exercise.sentence = db.fetchCachedExercise(card.id, promptHash, model, hash);
+            // Optionally top the card up to several sentences in the background
+            entry.topUp = topUp && !entry.exercise.sentence.isEmpty() && db.countCachedExercises(card.id, promptHash, model, hash) < perCard;
+            drawn.append(entry);
+        }
+        return drawn;
+    }, this, [this, deckId](const QVector<DrawnCard> &drawn) {
+        refilling.remove(deckId);
+        if (drawn.isEmpty())
+        {
+            if (queues[deckId].isEmpty() && inFlight[deckId] == 0)
+            {
+                emit noCards(deckId);
+            }
+            return;
+        }
+        for (const DrawnCard &entry : drawn)
+        {
+            if (entry.exercise.sentence.isEmpty())
+            {
+                generate(deckId, entry.exercise, true);
+                continue;
+            }
+            cacheHitCount++;
+            if (entry.topUp)
+            {
+                generate(deckId, entry.exercise, false);
+            }
+            deliver(deckId, entry.exercise);
+        }
+        // A round running out hands back fewer cards than asked for
+        refill();
+    });
+}
+
+void ExercisePrefetcher::generate(int deckId, const Exercise &card, bool enqueue)
+{
+    if (enqueue)
+    {
+        inFlight[deckId]++;
+    }
+    generator(card.frontSide, card.backSide, [this, deckId, card, enqueue](const QString &sentence) {
+        if (enqueue)
+        {
+            inFlight[deckId]--;
+        }
+        if (sentence.isEmpty())
+        {
+            // Don't retry in a loop against a failing server, the next request refills
+            return;
+        }
+        storeSentences({qMakePair(card, sentence)});
+        if (!enqueue)
+        {
+            return;
+        }
+        Exercise exercise = card;
+        exercise.sentence = sentence;
+        deliver(deckId, exercise);
+        if (deckId == activeDeckId)
+        {
+            refill();
+        }
+    });
+}
+
+void ExercisePrefetcher::deliver(int deckId, const Exercise &exercise)
+{
+    if (deckId == activeDeckId && waiter && waiterContext)
+    {
+        auto onReady = std::move(waiter);
+        waiter = nullptr;
+        waiterContext = nullptr;
+        onReady(exercise);
+    }
+    else
+    {
+        queues[deckId].enqueue(exercise);
+    }
+    emit exerciseReady(deckId);
+}
+
+int ExercisePrefetcher::queueDepth(int deckId) const
+{
+    return queues.value(deckId).size();
+}
+
+int ExercisePrefetcher::hits() const
+{
+    return hitCount;
+}
+
+int ExercisePrefetcher::misses() const
+{
+    return missCount;
+}
+
+int ExercisePrefetcher::cacheHits() const
+{
+    return cacheHitCount;
+}
+
+void ExercisePrefetcher::logStats() const
+{
+    qDebug() << "Exercise prefetch: deck" << activeDeckId
+             << "queue depth" << queueDepth(activeDeckId) << "/" << prefetchDepth
+             << "in flight" << inFlight.value(activeDeckId)
+             << "hits" << hitCount << "misses" << missCount
+             << "cache hits" << cacheHitCount;
+}
@@ -0,0 +1,123 @@
+#ifndef EXERCISEPREFETCHER_H
+#define EXERCISEPREFETCHER_H
+
+#include <QObject>
+#include <QMap>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "DBManager.h"
+#include "AsyncDBManager.h"
+#include "CardSampler.h"
+
+struct Exercise
+{
+    int cardId = -1;
+    QString frontSide;
+    QString backSide;
+    QString sentence;
+};
+
+// Keeps a queue of generated exercises per deck so that "Next Exercise"
+// can be answered from memory instead of waiting for the LLM round-trip.
+// Generated sentences are stored in the exercise cache table and served
+// from there first, so a warm deck needs no LLM calls at all. Cards are
+// drawn from the database a queue's worth at a time, the deck itself is
+// never loaded to serve exercises.
+class ExercisePrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Generates a sentence for the card and calls onResponse with it (empty on failure)
+    using Generator = std::function<void(const QString &frontSide, const QString &backSide, std::function<void(const QString &sentence)> onResponse)>;
+
+    // Same as Generator but also reports the partial sentence while it is generated,
+    // the request belongs to context and is cancelled with it. onResponse only gets
+    // the sentence once the stream completed, a failed or cut off stream gives an empty one.
+    using StreamGenerator = std::function<void(const QString &frontSide, const QString &backSide, QObject *context, std::function<void(const QString &partial)> onPartial, std::function<void(const QString &sentence)> onResponse)>;
+
+    // Generates sentences for many cards in one request, onResult is called per card as results arrive
+    using BatchGenerator = std::function<void(const QVector<Exercise> &cards, std::function<void(int cardId, const QString &sentence)> onResult, std::function<void()> onFinished)>;
+
+    // Every database access goes through asyncDb, off the GUI thread
+    ExercisePrefetcher(AsyncDBManager *asyncDb, Generator generator, QObject *parent = nullptr);
+    void setStreamGenerator(StreamGenerator streamGenerator);
+    void setBatchGenerator(BatchGenerator batchGenerator, int batchSize);
+
+    void setDepth(int depth);
+    int depth() const;
+    void setCacheKey(const QString &model, const QString &promptTemplate);
+    void setCacheLimit(int sentencesPerCard);
+    void setRegenerate(bool enabled);
+    // Whether a card comes up again before the rest of the deck was seen in the session
+    void setWithoutReplacement(bool enabled);
+
+    // Starts a new session for the deck unless it is already the active one,
+    // noCards() is emitted if the deck turns out to be empty
+    void start(int deckId);
+    void stop();
+    void invalidateDeck(int deckId);
+    // Fills the exercise cache for every card of the deck that has no sentence yet,
+    // onStarted gets the number of such cards once the deck was read
+    void pregenerate(int deckId, QObject *context, std::function<void(int missing)> onStarted);
+
+    // Returns true when the exercise was served straight from the queue, before
+    // any database work, otherwise onReady is called once the next exercise has
+    // been generated. With a stream generator a miss is generated on the spot
+    // and onPartial receives the text as it arrives.
+    bool requestExercise(QObject *context, std::function<void(const Exercise &exercise)> onReady, std::function<void(const QString &partial)> onPartial = nullptr);
+
+    int queueDepth(int deckId) const;
+    int hits() const;
+    int misses() const;
+    int cacheHits() const;
+    void logStats() const;
+
+signals:
+    void exerciseReady(int deckId);
+    void pregenerateProgress(int deckId, int done, int total);
+    void noCards(int deckId);
+
+private:
+    // Draws the cards the queue is short of and looks up their cached sentences in one job on the database worker
+    void refill();
+    QSharedPointer<CardSampler> sampler(int deckId);
+    void generate(int deckId, const Exercise &card, bool enqueue);
+    void deliver(int deckId, const Exercise &exercise);
+    static QString cardHash(const Exercise &card);
+    void submitBatch(int deckId, QVector<Exercise> cards, int done, int total);
+    // Adds generated sentences to the exercise cache in one transaction on the database worker
+    void storeSentences(const QVector<QPair<Exercise, QString>> &sentences);
+
+    AsyncDBManager *asyncDb;
+    Generator generator;
+    StreamGenerator streamGenerator;
+    BatchGenerator batchGenerator;
+    int batchSize = 50;
+    int prefetchDepth = 3;
+    int activeDeckId = -1;
+    int hitCount = 0;
+    int missCount = 0;
+    int cacheHitCount = 0;
+    QString model;
+    QString promptHash;
+    int cachePerCard = 5;
+    bool regenerate = false;
+    bool withoutReplacement = true;
+    QMap<int, QSharedPointer<CardSampler>> samplers;
+    QMap<int, QQueue<Exercise>> queues;
+    QMap<int, int> inFlight;
+    // Decks with a refill job on the database worker
+    QSet<int> refilling;
+    QPointer<QObject> waiterContext;
+    std::function<void(const Exercise &exercise)> waiter;
+    // Counts requests, a stream started for an older request's waiter is not started any more
+    int waiterRequest = 0;
+};
+
+#endif // EXERCISEPREFETCHER_H
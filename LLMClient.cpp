@@ -0,0 +1,597 @@
+#include "LLMClient.h"
+
+#include <QJsonDocument>
+#include <QNetworkRequest>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+LLMClient::LLMClient(const QList<QUrl> &backendUrls, QObject *parent)
+    : QObject(parent), manager(new QNetworkAccessManager(this))
+{
+    clock.start();
+    setBackends(backendUrls);
+}
+
+void LLMClient::setBackends(const QList<QUrl> &backendUrls)
+{
+    // Backends that stay keep their id, statistics and outstanding count. Attempts in flight refer
+    // to their backend by id, results for a backend that is gone are ignored.
+    QVector<Backend> updated;
+    for (const QUrl &url : backendUrls)
+    {
+        auto kept = std::find_if(backends.begin(), backends.end(), [&url](const Backend &backend) { return backend.url == url; });
+        if (kept != backends.end())
+        {
+            updated.append(*kept);
+            backends.erase(kept);
+            continue;
+        }
+        Backend backend;
+        backend.id = nextBackendId++;
+        backend.url = url;
+        updated.append(backend);
+    }
+    backends = updated;
+    dispatch();
+}
+
+void LLMClient::setMaxConcurrent(int maxConcurrent)
+{
+    this->maxConcurrent = qMax(1, maxConcurrent);
+    dispatch();
+}
+
+void LLMClient::setTimeout(int timeoutMs)
+{
+    this->timeoutMs = timeoutMs;
+}
+
+void LLMClient::setHedging(bool enabled, int defaultDelayMs)
+{
+    hedging = enabled;
+    defaultHedgeDelayMs = qMax(0, defaultDelayMs);
+}
+
+void LLMClient::post(const QString &path, const QJsonObject &body, Priority priority, QObject *context,
+                     FinishedCallback onFinished, LineCallback onLine, const QString &dedupKey)
+{
+    Waiter waiter;
+    waiter.owner = context;
+    waiter.context = context;
+    waiter.onFinished = std::move(onFinished);
+    waiter.onLine = std::move(onLine);
+    track(context);
+
+    const QString key = dedupKey.isEmpty() ? QString() : path + '\n' + dedupKey;
+    if (!key.isEmpty() && inFlight.contains(key))
+    {
+        JobPtr job = inFlight.value(key);
+        job->waiters.append(waiter);
+        // An interactive caller promotes a queued background request
+        if (priority == Interactive && job->priority == Background && pending[Background].removeOne(job))
+        {
+            job->priority = Interactive;
+            pending[Interactive].append(job);
+            dispatch();
+        }
+        return;
+    }
+
+    JobPtr job = JobPtr::create();
+    job->path = path;
+    job->body = QJsonDocument(body).toJson(QJsonDocument::Compact);
+    job->priority = priority;
+    job->dedupKey = key;
+    job->waiters.append(waiter);
+    if (!key.isEmpty())
+    {
+        inFlight.insert(key, job);
+    }
+    pending[priority].append(job);
+    dispatch();
+}
+
+void LLMClient::cancel(QObject *context)
+{
+    if (!context)
+    {
+        return;
+    }
+    QList<FinishedCallback> cancelled;
+    auto dropWaiters = [context, &cancelled](const JobPtr &job) {
+        for (int i = job->waiters.size() - 1; i >= 0; --i)
+        {
+            if (job->waiters[i].owner == context)
+            {
+                if (job->waiters[i].context)
+                {
+                    cancelled.append(job->waiters[i].onFinished);
+                }
+                job->waiters.removeAt(i);
+            }
+        }
+    };
+
+    for (QList<JobPtr> &queue : pending)
+    {
+        for (int i = queue.size() - 1; i >= 0; --i)
+        {
+            JobPtr job = queue[i];
+            dropWaiters(job);
+            if (job->waiters.isEmpty())
+            {
+                queue.removeAt(i);
+                inFlight.remove(job->dedupKey);
+            }
+        }
+    }
+    const QList<JobPtr> running = active;
+    for (const JobPtr &job : running)
+    {
+        dropWaiters(job);
+        if (job->waiters.isEmpty())
+        {
+            // finish() runs from the replies' finished signals
+            abortAttempts(job);
+        }
+    }
+
+    // A living context still hears about the cancellation, e.g. to release its bookkeeping
+    for (const FinishedCallback &onFinished : cancelled)
+    {
+        if (onFinished)
+        {
+            onFinished(QByteArray());
+        }
+    }
+}
+
+int LLMClient::activeCount() const
+{
+    return active.size();
+}
+
+int LLMClient::pendingCount() const
+{
+    return pending[Interactive].size() + pending[Background].size();
+}
+
+void LLMClient::logStats() const
+{
+    for (int i = 0; i < backends.size(); ++i)
+    {
+        qDebug() << "LLM backend" << backends[i].url.toString()
+                 << "outstanding" << backends[i].outstanding
+                 << "failures" << backends[i].failures
+                 << "healthy" << (backends[i].unhealthyUntil <= clock.elapsed())
+                 << "hedge delay ms" << hedgeDelay(i);
+    }
+    qDebug() << "LLM hedged requests" << hedgesSent << "won by the hedge" << hedgesWon;
+}
+
+void LLMClient::track(QObject *context)
+{
+    if (!context || trackedContexts.contains(context))
+    {
+        return;
+    }
+    trackedContexts.insert(context);
+    // Leaving a view destroys it, which cancels whatever it was waiting for
+    connect(context, &QObject::destroyed, this, [this, context]() {
+        trackedContexts.remove(context);
+        cancel(context);
+    });
+}
+
+bool LLMClient::hasLiveWaiter(const JobPtr &job)
+{
+    for (const Waiter &waiter : job->waiters)
+    {
+        if (!waiter.owner || waiter.context)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LLMClient::dispatch()
+{
+    if (backends.isEmpty())
+    {
+        return;
+    }
+    // With more than one slot background work leaves the last one free, so an interactive request can
+    // always start. A single slot is shared, otherwise background work would never run, and an
+    // interactive request then waits for the background one in flight.
+    const int slots = maxConcurrent * backends.size();
+    const int backgroundSlots = slots > 1 ? slots - 1 : 1;
+    while (active.size() < slots)
+    {
+        JobPtr job;
+        if (!pending[Interactive].isEmpty())
+        {
+            job = pending[Interactive].takeFirst();
+        }
+        else if (!pending[Background].isEmpty() && active.size() < backgroundSlots)
+        {
+            job = pending[Background].takeFirst();
+        }
+        else
+        {
+            break;
+        }
+        if (!hasLiveWaiter(job))
+        {
+            inFlight.remove(job->dedupKey);
+            continue;
+        }
+        start(job);
+    }
+}
+
+int LLMClient::pickBackend(int exclude) const
+{
+    // Least outstanding requests among the healthy backends
+    const qint64 now = clock.elapsed();
+    int best = -1;
+    for (int i = 0; i < backends.size(); ++i)
+    {
+        if (i == exclude || backends[i].unhealthyUntil > now)
+        {
+            continue;
+        }
+        if (best == -1 || backends[i].outstanding < backends[best].outstanding)
+        {
+            best = i;
+        }
+    }
+    if (best != -1 || exclude != -1)
+    {
+        return best;
+    }
+    // Everything is marked unhealthy, probe the one that has been waiting the longest
+    for (int i = 0; i < backends.size(); ++i)
+    {
+        if (best == -1 || backends[i].unhealthyUntil < backends[best].unhealthyUntil)
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int LLMClient::indexOf(int backendId) const
+{
+    for (int i = 0; i < backends.size(); ++i)
+    {
+        if (backends[i].id == backendId)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool LLMClient::isSuccess(QNetworkReply *reply)
+{
+    const QVariant status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    return !status.isValid() || (status.toInt() >= 200 && status.toInt() < 300);
+}
+
+qint64 LLMClient::hedgeDelay(int backend) const
+{
+    if (backend < 0 || backend >= backends.size() || backends[backend].latencies.size() < 10)
+    {
+        return defaultHedgeDelayMs;
+    }
+    QVector<qint64> latencies = backends[backend].latencies;
+    std::sort(latencies.begin(), latencies.end());
+    return latencies[qMax(0, int(std::ceil(latencies.size() * 0.95)) - 1)];
+}
+
+void LLMClient::recordSuccess(int backend, qint64 latencyMs)
+{
+    if (backend < 0 || backend >= backends.size())
+    {
+        return;
+    }
+    Backend &target = backends[backend];
+    target.failures = 0;
+    target.unhealthyUntil = 0;
+    // Ring buffer of the most recent times to first byte
+    if (target.latencies.size() < 100)
+    {
+        target.latencies.append(latencyMs);
+    }
+    else
+    {
+        target.latencies[target.nextLatency] = latencyMs;
+        target.nextLatency = (target.nextLatency + 1) % target.latencies.size();
+    }
+}
+
+void LLMClient::recordFailure(int backend)
+{
+    if (backend < 0 || backend >= backends.size())
+    {
+        return;
+    }
+    Backend &target = backends[backend];
+    target.failures++;
+    if (target.failures >= 3)
+    {
+        // Back off from a failing backend, up to a minute
+        const qint64 backoff = qMin<qint64>(60000, 5000LL << qMin(target.failures - 3, 4));
+        target.unhealthyUntil = clock.elapsed() + backoff;
+        qDebug() << "LLM backend" << target.url.toString() << "marked unhealthy for" << backoff << "ms";
+    }
+}
+
+void LLMClient::start(const JobPtr &job)
+{
+    active.append(job);
+
+    // Streaming replies restart the deadline with every chunk they deliver
+    job->deadline = new QTimer(this);
+    job->deadline->setSingleShot(true);
+    connect(job->deadline, &QTimer::timeout, this, [this, job]() {
+        job->timedOut = true;
+        abortAttempts(job);
+    });
+    job->deadline->start(timeoutMs);
+
+    const int backend = pickBackend(-1);
+    const int backendId = backends[backend].id;
+    startAttempt(job, backend);
+
+    if (hedging && backends.size() > 1)
+    {
+        job->hedgeTimer = new QTimer(this);
+        job->hedgeTimer->setSingleShot(true);
+        connect(job->hedgeTimer, &QTimer::timeout, this, [this, job, backendId]() {
+            if (job->winner || job->attempts.isEmpty())
+            {
+                return;
+            }
+            const int hedge = pickBackend(indexOf(backendId));
+            if (hedge != -1)
+            {
+                hedgesSent++;
+                startAttempt(job, hedge, true);
+            }
+        });
+        job->hedgeTimer->start(int(hedgeDelay(backend)));
+    }
+}
+
+void LLMClient::startAttempt(const JobPtr &job, int backend, bool hedge)
+{
+    QUrl url = backends[backend].url.resolved(QUrl(job->path));
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    Attempt attempt;
+    attempt.reply = manager->post(request, job->body);
+    attempt.backendId = backends[backend].id;
+    attempt.startedAt = clock.elapsed();
+    attempt.hedge = hedge;
+    job->attempts.append(attempt);
+    backends[backend].outstanding++;
+
+    QNetworkReply *reply = attempt.reply;
+    connect(reply, &QNetworkReply::readyRead, this, [this, job, reply]() { attemptReadyRead(job, reply); });
+    connect(reply, &QNetworkReply::finished, this, [this, job, reply]() { attemptFinished(job, reply); });
+}
+
+void LLMClient::chooseWinner(const JobPtr &job, QNetworkReply *reply)
+{
+    // The first backend to answer wins, the other copy is aborted
+    job->winner = reply;
+    for (const Attempt &attempt : job->attempts)
+    {
+        if (attempt.reply == reply)
+        {
+            recordSuccess(indexOf(attempt.backendId), clock.elapsed() - attempt.startedAt);
+            if (attempt.hedge)
+            {
+                hedgesWon++;
+            }
+        }
+    }
+    if (job->hedgeTimer)
+    {
+        job->hedgeTimer->stop();
+    }
+    abortAttempts(job, reply);
+}
+
+void LLMClient::attemptReadyRead(const JobPtr &job, QNetworkReply *reply)
+{
+    // An error page doesn't win, the attempt fails when it finishes and the other copy or the failover carries on
+    if (!job->winner && isSuccess(reply))
+    {
+        chooseWinner(job, reply);
+    }
+    if (reply != job->winner)
+    {
+        return;
+    }
+    job->deadline->start(timeoutMs);
+    readLines(job);
+}
+
+void LLMClient::attemptFinished(const JobPtr &job, QNetworkReply *reply)
+{
+    const QNetworkReply::NetworkError error = reply->error();
+    if (!job->winner && error == QNetworkReply::NoError && isSuccess(reply))
+    {
+        // Finished without a readyRead, e.g. an empty body
+        chooseWinner(job, reply);
+    }
+
+    int backend = -1;
+    for (int i = 0; i < job->attempts.size(); ++i)
+    {
+        if (job->attempts[i].reply == reply)
+        {
+            backend = indexOf(job->attempts[i].backendId);
+            job->attempts.removeAt(i);
+            break;
+        }
+    }
+    if (backend >= 0)
+    {
+        backends[backend].outstanding--;
+    }
+    reply->deleteLater();
+
+    if (reply == job->winner)
+    {
+        QByteArray response;
+        if (error == QNetworkReply::NoError)
+        {
+            readLines(job);
+            if (!job->lineBuffer.isEmpty())
+            {
+                // Last line without a trailing newline
+                job->lineBuffer.append('\n');
+                readLines(job);
+            }
+            // A batch keeps the lines that arrived before the error, the body as a whole is not a result
+            if (!job->failed)
+            {
+                response = job->response;
+            }
+        }
+        else
+        {
+            if (error != QNetworkReply::OperationCanceledError || job->timedOut)
+            {
+                recordFailure(backend);
+            }
+            if (job->timedOut)
+            {
+                qDebug() << "LLM request timed out after" << timeoutMs << "ms:" << job->path;
+            }
+            else if (error != QNetworkReply::OperationCanceledError)
+            {
+                qDebug() << "Error:" << reply->errorString();
+            }
+        }
+        finish(job, response);
+        return;
+    }
+
+    if (job->winner)
+    {
+        // The losing copy of a hedged request
+        return;
+    }
+    if (error != QNetworkReply::OperationCanceledError)
+    {
+        qDebug() << "Error from" << reply->url().toString() << ":" << reply->errorString();
+    }
+    if (error != QNetworkReply::OperationCanceledError || job->timedOut)
+    {
+        recordFailure(backend);
+    }
+    if (!job->attempts.isEmpty())
+    {
+        // The other copy may still answer
+        return;
+    }
+    if (job->timedOut)
+    {
+        qDebug() << "LLM request timed out after" << timeoutMs << "ms:" << job->path;
+    }
+    else if (error != QNetworkReply::OperationCanceledError && !job->retried && hasLiveWaiter(job))
+    {
+        // Fail over once to another backend before giving up
+        const int other = pickBackend(backend);
+        if (other != -1)
+        {
+            job->retried = true;
+            startAttempt(job, other);
+            return;
+        }
+    }
+    finish(job, QByteArray());
+}
+
+void LLMClient::abortAttempts(const JobPtr &job, QNetworkReply *keep)
+{
+    // abort() emits finished synchronously, which removes the attempt
+    const QList<Attempt> attempts = job->attempts;
+    for (const Attempt &attempt : attempts)
+    {
+        if (attempt.reply != keep)
+        {
+            attempt.reply->abort();
+        }
+    }
+}
+
+void LLMClient::readLines(const JobPtr &job)
+{
+    const QByteArray chunk = job->winner->readAll();
+    job->response.append(chunk);
+    job->lineBuffer.append(chunk);
+    int newline;
+    while ((newline = job->lineBuffer.indexOf('\n')) != -1)
+    {
+        const QByteArray line = job->lineBuffer.left(newline);
+        job->lineBuffer.remove(0, newline + 1);
+        QJsonObject object = QJsonDocument::fromJson(line).object();
+        if (object.isEmpty())
+        {
+            continue;
+        }
+        if (object.contains("error"))
+        {
+            qDebug() << "Server error:" << object["error"].toString();
+            job->failed = true;
+            continue;
+        }
+        // Copy, a callback may cancel and change the waiter list
+        const QList<Waiter> waiters = job->waiters;
+        for (const Waiter &waiter : waiters)
+        {
+            if (waiter.onLine && (!waiter.owner || waiter.context))
+            {
+                waiter.onLine(object);
+            }
+        }
+    }
+}
+
+void LLMClient::finish(const JobPtr &job, const QByteArray &response)
+{
+    active.removeOne(job);
+    if (!job->dedupKey.isEmpty() && inFlight.value(job->dedupKey) == job)
+    {
+        inFlight.remove(job->dedupKey);
+    }
+    // May be running inside the deadline's own timeout
+    job->deadline->stop();
+    job->deadline->deleteLater();
+    job->deadline = nullptr;
+    if (job->hedgeTimer)
+    {
+        job->hedgeTimer->stop();
+        job->hedgeTimer->deleteLater();
+        job->hedgeTimer = nullptr;
+    }
+
+    const QList<Waiter> waiters = job->waiters;
+    job->waiters.clear();
+    for (const Waiter &waiter : waiters)
+    {
+        if (waiter.onFinished && (!waiter.owner || waiter.context))
+        {
+            waiter.onFinished(response);
+        }
+    }
+    dispatch();
+}
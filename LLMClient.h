@@ -0,0 +1,145 @@
+#ifndef LLMCLIENT_H
+#define LLMCLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+#include <functional>
+
+// Single long-lived client for the exercise generation servers. It owns one
+// QNetworkAccessManager (so connections are kept alive and reused), limits
+// how many requests run at once, lets interactive requests go ahead of
+// background ones, collapses identical requests and aborts a request once
+// it has made no progress for the timeout. Callbacks are tied to a context
+// object: when it is destroyed or cancelled its requests are dropped and
+// aborted if nobody else waits.
+//
+// Requests are routed to the healthy backend with the fewest outstanding
+// requests. With hedging enabled a request that got no answer within the
+// backend's p95 time to first byte is sent to a second backend as well and
+// whichever answers first is used.
+class LLMClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority { Interactive, Background };
+
+    // Called once with the whole reply body, an empty body means the request failed or was cancelled.
+    // A reply carrying an {"error": ...} line failed, even if the lines before it arrived.
+    using FinishedCallback = std::function<void(const QByteArray &response)>;
+    // Called for every complete NDJSON line of a streaming reply
+    using LineCallback = std::function<void(const QJsonObject &line)>;
+
+    explicit LLMClient(const QList<QUrl> &backendUrls, QObject *parent = nullptr);
+
+    void setBackends(const QList<QUrl> &backendUrls);
+    void setMaxConcurrent(int maxConcurrent);
+    void setTimeout(int timeoutMs);
+    // defaultDelayMs is used until a backend has enough latency samples for its p95
+    void setHedging(bool enabled, int defaultDelayMs);
+
+    // Requests with the same non-empty dedupKey share one reply while it is in flight
+    void post(const QString &path, const QJsonObject &body, Priority priority, QObject *context,
+              FinishedCallback onFinished, LineCallback onLine = nullptr, const QString &dedupKey = QString());
+    void cancel(QObject *context);
+
+    int activeCount() const;
+    int pendingCount() const;
+    void logStats() const;
+
+private:
+    struct Backend
+    {
+        // Stays the same while the backend is configured, indexes change with setBackends
+        int id = -1;
+        QUrl url;
+        int outstanding = 0;
+        int failures = 0;
+        qint64 unhealthyUntil = 0;
+        QVector<qint64> latencies;
+        int nextLatency = 0;
+    };
+    struct Waiter
+    {
+        QObject *owner = nullptr;
+        QPointer<QObject> context;
+        FinishedCallback onFinished;
+        LineCallback onLine;
+    };
+    struct Attempt
+    {
+        QNetworkReply *reply = nullptr;
+        int backendId = -1;
+        qint64 startedAt = 0;
+        bool hedge = false;
+    };
+    struct Job
+    {
+        QString path;
+        QByteArray body;
+        Priority priority = Background;
+        QString dedupKey;
+        QList<Waiter> waiters;
+        QList<Attempt> attempts;
+        QNetworkReply *winner = nullptr;
+        QTimer *deadline = nullptr;
+        QTimer *hedgeTimer = nullptr;
+        QByteArray response;
+        QByteArray lineBuffer;
+        bool timedOut = false;
+        // The server reported an error in the body
+        bool failed = false;
+        bool retried = false;
+    };
+    using JobPtr = QSharedPointer<Job>;
+
+    void dispatch();
+    void start(const JobPtr &job);
+    void startAttempt(const JobPtr &job, int backend, bool hedge = false);
+    void attemptReadyRead(const JobPtr &job, QNetworkReply *reply);
+    void attemptFinished(const JobPtr &job, QNetworkReply *reply);
+    void chooseWinner(const JobPtr &job, QNetworkReply *reply);
+    void readLines(const JobPtr &job);
+    void finish(const JobPtr &job, const QByteArray &response);
+    void abortAttempts(const JobPtr &job, QNetworkReply *keep = nullptr);
+    void track(QObject *context);
+    int pickBackend(int exclude) const;
+    // Index of the backend with that id, -1 once it was removed
+    int indexOf(int backendId) const;
+    // Whether the reply is an answer and not an HTTP error page
+    static bool isSuccess(QNetworkReply *reply);
+    void recordSuccess(int backend, qint64 latencyMs);
+    void recordFailure(int backend);
+    qint64 hedgeDelay(int backend) const;
+    static bool hasLiveWaiter(const JobPtr &job);
+
+    QNetworkAccessManager *manager;
+    QVector<Backend> backends;
+    int nextBackendId = 0;
+    QElapsedTimer clock;
+    int maxConcurrent = 2;
+    int timeoutMs = 60000;
+    bool hedging = false;
+    int defaultHedgeDelayMs = 3000;
+    int hedgesSent = 0;
+    int hedgesWon = 0;
+    QList<JobPtr> pending[2];
+    QList<JobPtr> active;
+    QHash<QString, JobPtr> inFlight;
+    QSet<QObject *> trackedContexts;
+};
+
+#endif // LLMCLIENT_H
@@ -0,0 +1,243 @@
+#include "ReviewScheduler.h"
+
+#include <QtMath>
+#include <QDebug>
+
+// An answer of "Again" shows the card again after this many minutes
+static const int relearnMinutes = 10;
+static const double minimumEase = 1.3;
+static const double easyBonus = 1.3;
+static const double hardFactor = 1.2;
+
+ReviewScheduler::ReviewScheduler(AsyncDBManager *asyncDb, QObject *parent)
+    : QObject(parent), asyncDb(asyncDb) {}
+
+void ReviewScheduler::setPageSize(int size)
+{
+    pageSize = qMax(1, size);
+}
+
+int ReviewScheduler::deckId() const
+{
+    return scope;
+}
+
+ReviewScheduler::Key ReviewScheduler::keyOf(const ReviewState &state)
+{
+    return Key(state.due.toMSecsSinceEpoch(), state.cardId);
+}
+
+ReviewScheduler::Key ReviewScheduler::boundary() const
+{
+    return Key(lastDue.toMSecsSinceEpoch(), lastCardId);
+}
+
+bool ReviewScheduler::covered() const
+{
+    // Graded cards go back into the set with their new due time, possibly past the last page read.
+    // Cards between that page and them are still in the database, so such an entry is not known to be first.
+    return exhausted || (!queue.empty() && *queue.begin() <= boundary());
+}
+
+void ReviewScheduler::start(int deckId)
+{
+    generation++;
+    scope = deckId;
+    started = true;
+    loading = false;
+    exhausted = false;
+    lastDue = QDateTime::fromMSecsSinceEpoch(0, Qt::UTC);
+    lastCardId = 0;
+    queue.clear();
+    states.clear();
+    fetchPage();
+}
+
+void ReviewScheduler::fetchPage()
+{
+    if (loading || exhausted)
+    {
+        return;
+    }
+    loading = true;
+    const int requested = generation;
+    const int deck = scope;
+    const QDateTime afterDue = lastDue;
+    const int afterCardId = lastCardId;
+    const int limit = pageSize;
+    asyncDb->run([deck, afterDue, afterCardId, limit](DBManager &db) {
+        return db.fetchDueCards(deck, afterDue, afterCardId, limit);
+    }, this, [this, requested](const QVector<ReviewState> &page) {
+        if (requested != generation)
+        {
+            return;
+        }
+        loading = false;
+        exhausted = page.size() < pageSize;
+        for (const ReviewState &state : page)
+        {
+            // A card graded while the page was read is newer in memory than in the page
+            if (!states.contains(state.cardId))
+            {
+                states.insert(state.cardId, state);
+                queue.insert(keyOf(state));
+            }
+        }
+        if (!page.isEmpty())
+        {
+            lastDue = page.last().due;
+            lastCardId = page.last().cardId;
+        }
+        if (waiter)
+        {
+            auto onCard = std::move(waiter);
+            QPointer<QObject> context = waiterContext;
+            waiter = nullptr;
+            waiterContext = nullptr;
+            if (context)
+            {
+                answer(context, onCard);
+            }
+        }
+    });
+}
+
+void ReviewScheduler::nextCard(QObject *context, std::function<void(const ReviewState &state)> onCard)
+{
+    if (!started)
+    {
+        start(scope);
+    }
+    // Read the next page ahead while fewer than a quarter of a page are left before its end
+    if (!exhausted)
+    {
+        const Key end = boundary();
+        int left = 0;
+        for (auto it = queue.begin(); it != queue.end() && *it <= end && left < pageSize / 4; ++it)
+        {
+            left++;
+        }
+        if (left < pageSize / 4)
+        {
+            fetchPage();
+        }
+    }
+    answer(context, onCard);
+}
+
+void ReviewScheduler::answer(QObject *context, std::function<void(const ReviewState &state)> onCard)
+{
+    if (!covered())
+    {
+        waiterContext = context;
+        // Only the visible view waits, a newer request replaces the old one
+        waiter = std::move(onCard);
+        fetchPage();
+        return;
+    }
+    if (queue.empty())
+    {
+        onCard(ReviewState());
+        return;
+    }
+    const ReviewState state = states.value(queue.begin()->second);
+    if (state.due > QDateTime::currentDateTimeUtc())
+    {
+        ReviewState nothingDue;
+        nothingDue.due = state.due;
+        onCard(nothingDue);
+        return;
+    }
+    onCard(state);
+}
+
+void ReviewScheduler::grade(int cardId, Grade grade)
+{
+    auto it = states.find(cardId);
+    if (it == states.end())
+    {
+        return;
+    }
+    queue.erase(keyOf(it.value()));
+    const ReviewState next = schedule(it.value(), grade, QDateTime::currentDateTimeUtc());
+    // Kept in the set even past the last page read, the page that covers it skips it
+    it.value() = next;
+    queue.insert(keyOf(next));
+    asyncDb->run([next](DBManager &db) {
+        return db.updateReviewState(next);
+    }, this, [cardId](bool ok) {
+        if (!ok)
+        {
+            qDebug() << "Review of card" << cardId << "was not saved";
+        }
+    });
+}
+
+void ReviewScheduler::remove(int cardId)
+{
+    auto it = states.find(cardId);
+    if (it == states.end())
+    {
+        return;
+    }
+    queue.erase(keyOf(it.value()));
+    states.erase(it);
+}
+
+void ReviewScheduler::addCard(int cardId, int deckId)
+{
+    if (!started || (scope != -1 && scope != deckId) || states.contains(cardId))
+    {
+        return;
+    }
+    ReviewState state;
+    state.cardId = cardId;
+    state.deckId = deckId;
+    state.due = QDateTime::currentDateTimeUtc();
+    states.insert(cardId, state);
+    queue.insert(keyOf(state));
+}
+
+void ReviewScheduler::invalidateDeck(int deckId)
+{
+    if (started && (scope == -1 || scope == deckId))
+    {
+        start(scope);
+    }
+}
+
+ReviewState ReviewScheduler::schedule(const ReviewState &state, Grade grade, const QDateTime &now)
+{
+    // SM-2: quality 5 for Easy down to 1 for Again, the ease changes with every answer
+    ReviewState next = state;
+    const int quality = grade == Again ? 1 : grade == Hard ? 3 : grade == Good ? 4 : 5;
+    next.ease = qMax(minimumEase, state.ease + 0.1 - (5 - quality) * (0.08 + (5 - quality) * 0.02));
+    if (grade == Again)
+    {
+        next.repetitions = 0;
+        next.lapses = state.lapses + 1;
+        next.intervalDays = relearnMinutes / (24.0 * 60.0);
+    }
+    else
+    {
+        if (state.repetitions == 0)
+        {
+            next.intervalDays = grade == Easy ? 4 : 1;
+        }
+        else if (state.repetitions == 1)
+        {
+            next.intervalDays = grade == Hard ? 3 : 6;
+        }
+        else if (grade == Hard)
+        {
+            next.intervalDays = qMax(1.0, state.intervalDays * hardFactor);
+        }
+        else
+        {
+            next.intervalDays = state.intervalDays * next.ease * (grade == Easy ? easyBonus : 1.0);
+        }
+        next.repetitions = state.repetitions + 1;
+    }
+    next.due = now.addMSecs(qint64(next.intervalDays * 24 * 60 * 60 * 1000));
+    return next;
+}
@@ -0,0 +1,72 @@
+#ifndef REVIEWSCHEDULER_H
+#define REVIEWSCHEDULER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QPointer>
+#include <functional>
+#include <set>
+#include <utility>
+#include "AsyncDBManager.h"
+
+// SM-2 review queue for one deck or for all decks at once. The cards due
+// first are read from review_state a page at a time along the (deck_id, due)
+// index and kept in an ordered set, so picking the next card and rescheduling
+// a graded one are O(log n) in memory. Grades are written back on the
+// database thread. Every card due before the last page read is in the set,
+// so its first entry is the card due first as long as it lies before the
+// end of that page; otherwise the next page is read before answering.
+class ReviewScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Grade { Again, Hard, Good, Easy };
+
+    ReviewScheduler(AsyncDBManager *asyncDb, QObject *parent = nullptr);
+    void setPageSize(int pageSize);
+
+    // deckId -1 mixes the cards of every deck
+    void start(int deckId);
+    int deckId() const;
+    // Calls onCard with the card due first. When nothing is due the card id is -1
+    // and due is the time the next card becomes due, invalid if there are no cards.
+    void nextCard(QObject *context, std::function<void(const ReviewState &state)> onCard);
+    void grade(int cardId, Grade grade);
+    // A card added elsewhere, due now like every new card
+    void addCard(int cardId, int deckId);
+    // Drops a card that no longer exists
+    void remove(int cardId);
+    // Many cards of the deck changed at once, the queue is read again if it covers the deck
+    void invalidateDeck(int deckId);
+
+    // The card's state after answering with grade at time now
+    static ReviewState schedule(const ReviewState &state, Grade grade, const QDateTime &now);
+
+private:
+    using Key = std::pair<qint64, int>;
+    static Key keyOf(const ReviewState &state);
+    // Position of the last card read from the database
+    Key boundary() const;
+    // Whether the first entry of the queue is the card due first
+    bool covered() const;
+    void fetchPage();
+    void answer(QObject *context, std::function<void(const ReviewState &state)> onCard);
+
+    AsyncDBManager *asyncDb;
+    int scope = -1;
+    bool started = false;
+    int pageSize = 500;
+    int generation = 0;
+    bool loading = false;
+    bool exhausted = false;
+    QDateTime lastDue;
+    int lastCardId = 0;
+    std::set<Key> queue;
+    QHash<int, ReviewState> states;
+    QPointer<QObject> waiterContext;
+    std::function<void(const ReviewState &state)> waiter;
+};
+
+#endif // REVIEWSCHEDULER_H
@@ -0,0 +1,246 @@
+#include "SchemaMigrations.h"
+
+const QVector<Migration> &schemaMigrations()
+{
+    static const QVector<Migration> migrations = {
+        {1, "decks table", {
+            "CREATE TABLE IF NOT EXISTS decks ( id SERIAL PRIMARY KEY, name VARCHAR(255) NOT NULL )",
+        }},
+        {2, "flashcards table", {
+            "CREATE TABLE IF NOT EXISTS flashcards ( id SERIAL PRIMARY KEY, frontSide TEXT NOT NULL, backSide TEXT NOT NULL, deck_id INTEGER NOT NULL, FOREIGN KEY (deck_id) REFERENCES decks(id) ON DELETE CASCADE )",
+        }},
+        // Every per-deck card query, sampling and the ON DELETE CASCADE from decks filter on deck_id
+        {3, "flashcards deck index", {
+            "CREATE INDEX IF NOT EXISTS flashcards_deck_id_idx ON flashcards (deck_id, id)",
+        }},
+        // Generated sentences keyed by card, prompt template and model; card_hash detects edited cards
+        {4, "exercise cache", {
+            "CREATE TABLE IF NOT EXISTS exercise_cache ( id SERIAL PRIMARY KEY, card_id INTEGER NOT NULL, prompt_hash VARCHAR(64) NOT NULL, model VARCHAR(255) NOT NULL, card_hash VARCHAR(64) NOT NULL, sentence TEXT NOT NULL, served_count INTEGER NOT NULL DEFAULT 0, created_at TIMESTAMP NOT NULL DEFAULT now(), FOREIGN KEY (card_id) REFERENCES flashcards(id) ON DELETE CASCADE )",
+            "CREATE INDEX IF NOT EXISTS exercise_cache_key_idx ON exercise_cache (card_id, prompt_hash, model)",
+            // The startup trim drops the oldest sentences first
+            "CREATE INDEX IF NOT EXISTS exercise_cache_age_idx ON exercise_cache (created_at, id)",
+        }},
+        // deck_id is copied from the card so the due queue of a deck is a range of the index
+        {5, "review state", {
+            "CREATE TABLE IF NOT EXISTS review_state ( card_id INTEGER PRIMARY KEY, deck_id INTEGER NOT NULL, due TIMESTAMPTZ NOT NULL DEFAULT now(), interval_days DOUBLE PRECISION NOT NULL DEFAULT 0, ease DOUBLE PRECISION NOT NULL DEFAULT 2.5, repetitions INTEGER NOT NULL DEFAULT 0, lapses INTEGER NOT NULL DEFAULT 0, FOREIGN KEY (card_id) REFERENCES flashcards(id) ON DELETE CASCADE )",
+            "CREATE INDEX IF NOT EXISTS review_state_deck_due_idx ON review_state (deck_id, due, card_id)",
+            "CREATE INDEX IF NOT EXISTS review_state_due_idx ON review_state (due, card_id)",
+            "CREATE OR REPLACE FUNCTION sync_review_state() RETURNS trigger AS $$ BEGIN "
+            "IF TG_OP = 'INSERT' THEN INSERT INTO review_state (card_id, deck_id) VALUES (NEW.id, NEW.deck_id) ON CONFLICT DO NOTHING; "
+            "ELSIF OLD.deck_id <> NEW.deck_id THEN UPDATE review_state SET deck_id = NEW.deck_id WHERE card_id = NEW.id; END IF; "
+            "RETURN NEW; END $$ LANGUAGE plpgsql",
+            "DROP TRIGGER IF EXISTS flashcards_review_state ON flashcards",
+            "CREATE TRIGGER flashcards_review_state AFTER INSERT OR UPDATE OF deck_id ON flashcards FOR EACH ROW EXECUTE PROCEDURE sync_review_state()",
+            // Cards that existed before the table are new cards, due now
+            "INSERT INTO review_state (card_id, deck_id) SELECT id, deck_id FROM flashcards ON CONFLICT DO NOTHING",
+        }},
+        // Other clients learn about changed rows through LISTEN instead of re-reading the tables.
+        // A bulk import sets flashcards.bulk_import and sends one IMPORT notification for the deck instead.
+        {6, "change notifications", {
+            "CREATE OR REPLACE FUNCTION notify_deck_change() RETURNS trigger AS $$ BEGIN "
+            "IF TG_OP = 'DELETE' THEN PERFORM pg_notify('deck_changes', json_build_object('op', TG_OP, 'id', OLD.id)::text); RETURN OLD; END IF; "
+            "PERFORM pg_notify('deck_changes', json_build_object('op', TG_OP, 'id', NEW.id, 'name', NEW.name)::text); RETURN NEW; "
+            "END $$ LANGUAGE plpgsql",
+            "CREATE OR REPLACE FUNCTION notify_flashcard_change() RETURNS trigger AS $$ BEGIN "
+            "IF current_setting('flashcards.bulk_import', true) = 'on' THEN RETURN NULL; END IF; "
+            "IF TG_OP = 'DELETE' THEN PERFORM pg_notify('flashcard_changes', json_build_object('op', TG_OP, 'id', OLD.id, 'deck_id', OLD.deck_id)::text); RETURN OLD; END IF; "
+            "IF TG_OP = 'UPDATE' AND OLD.deck_id <> NEW.deck_id THEN PERFORM pg_notify('flashcard_changes', json_build_object('op', 'DELETE', 'id', OLD.id, 'deck_id', OLD.deck_id)::text); END IF; "
+            "PERFORM pg_notify('flashcard_changes', json_build_object('op', TG_OP, 'id', NEW.id, 'deck_id', NEW.deck_id)::text); RETURN NEW; "
+            "END $$ LANGUAGE plpgsql",
+            "DROP TRIGGER IF EXISTS decks_notify ON decks",
+            "CREATE TRIGGER decks_notify AFTER INSERT OR UPDATE OR DELETE ON decks FOR EACH ROW EXECUTE PROCEDURE notify_deck_change()",
+            "DROP TRIGGER IF EXISTS flashcards_notify ON flashcards",
+            "CREATE TRIGGER flashcards_notify AFTER INSERT OR UPDATE OR DELETE ON flashcards FOR EACH ROW EXECUTE PROCEDURE notify_flashcard_change()",
+        }},
+        // Decks and cards get a uid that is the same in every database they are synced to and the time of
+        // their last change in milliseconds. An UPDATE that does not set updated_at itself is stamped with
+        // the current time, the sync engine sets it to the time of the change it copies.
+        // Deleted rows leave a tombstone so the deletion reaches the other databases as well.
+        {7, "sync metadata", {
+            "ALTER TABLE decks ADD COLUMN IF NOT EXISTS uid TEXT",
+            "UPDATE decks SET uid = md5(random()::text || clock_timestamp()::text || id) WHERE uid IS NULL",
+            "ALTER TABLE decks ALTER COLUMN uid SET DEFAULT md5(random()::text || clock_timestamp()::text)",
+            "ALTER TABLE decks ALTER COLUMN uid SET NOT NULL",
+            "CREATE UNIQUE INDEX IF NOT EXISTS decks_uid_idx ON decks (uid)",
+            "ALTER TABLE decks ADD COLUMN IF NOT EXISTS updated_at BIGINT NOT NULL DEFAULT (extract(epoch from clock_timestamp()) * 1000)::bigint",
+            "CREATE INDEX IF NOT EXISTS decks_updated_idx ON decks (updated_at, uid)",
+            "ALTER TABLE flashcards ADD COLUMN IF NOT EXISTS uid TEXT",
+            "UPDATE flashcards SET uid = md5(random()::text || clock_timestamp()::text || id) WHERE uid IS NULL",
+            "ALTER TABLE flashcards ALTER COLUMN uid SET DEFAULT md5(random()::text || clock_timestamp()::text)",
+            "ALTER TABLE flashcards ALTER COLUMN uid SET NOT NULL",
+            "CREATE UNIQUE INDEX IF NOT EXISTS flashcards_uid_idx ON flashcards (uid)",
+            "ALTER TABLE flashcards ADD COLUMN IF NOT EXISTS updated_at BIGINT NOT NULL DEFAULT (extract(epoch from clock_timestamp()) * 1000)::bigint",
+            "CREATE INDEX IF NOT EXISTS flashcards_updated_idx ON flashcards (updated_at, uid)",
+            "CREATE TABLE IF NOT EXISTS deleted_rows ( uid TEXT PRIMARY KEY, table_name TEXT NOT NULL, deleted_at BIGINT NOT NULL )",
+            "CREATE INDEX IF NOT EXISTS deleted_rows_deleted_idx ON deleted_rows (deleted_at, uid)",
+            "CREATE OR REPLACE FUNCTION touch_row() RETURNS trigger AS $$ BEGIN "
+            "IF NEW.updated_at = OLD.updated_at THEN NEW.updated_at := (extract(epoch from clock_timestamp()) * 1000)::bigint; END IF; "
+            "RETURN NEW; END $$ LANGUAGE plpgsql",
+            "CREATE OR REPLACE FUNCTION record_deletion() RETURNS trigger AS $$ BEGIN "
+            "INSERT INTO deleted_rows (uid, table_name, deleted_at) VALUES (OLD.uid, TG_TABLE_NAME, (extract(epoch from clock_timestamp()) * 1000)::bigint) "
+            "ON CONFLICT (uid) DO UPDATE SET deleted_at = GREATEST(deleted_rows.deleted_at, EXCLUDED.deleted_at); "
+            "RETURN OLD; END $$ LANGUAGE plpgsql",
+            "DROP TRIGGER IF EXISTS decks_touch ON decks",
+            "CREATE TRIGGER decks_touch BEFORE UPDATE ON decks FOR EACH ROW EXECUTE PROCEDURE touch_row()",
+            "DROP TRIGGER IF EXISTS flashcards_touch ON flashcards",
+            "CREATE TRIGGER flashcards_touch BEFORE UPDATE ON flashcards FOR EACH ROW EXECUTE PROCEDURE touch_row()",
+            "DROP TRIGGER IF EXISTS decks_deleted ON decks",
+            "CREATE TRIGGER decks_deleted AFTER DELETE ON decks FOR EACH ROW EXECUTE PROCEDURE record_deletion()",
+            "DROP TRIGGER IF EXISTS flashcards_deleted ON flashcards",
+            "CREATE TRIGGER flashcards_deleted AFTER DELETE ON flashcards FOR EACH ROW EXECUTE PROCEDURE record_deletion()",
+        }},
+        // Word and prefix search over both sides of every card. The 'simple' configuration only lowercases,
+        // cards hold words of any language. Queries have to use the same expression to hit the index.
+        {8, "card search index", {
+            "CREATE INDEX IF NOT EXISTS flashcards_search_idx ON flashcards USING GIN (to_tsvector('simple', frontSide || ' ' || backSide))",
+        }},
+        // updated_at keeps the time of the change on the machine it was made on, for last writer wins, and a
+        // change pushed late or from a clock behind carries a time readers have long passed. Readers page on
+        // change_seq instead: the id of the transaction that wrote the row. They stop before the oldest
+        // transaction still running (DBManager::changeHorizon), so no row can commit behind their cursor.
+        {9, "change sequence", {
+            "ALTER TABLE decks ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS decks_change_idx ON decks (change_seq, uid)",
+            "ALTER TABLE flashcards ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS flashcards_change_idx ON flashcards (change_seq, uid)",
+            "ALTER TABLE deleted_rows ADD COLUMN IF NOT EXISTS change_seq BIGINT NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS deleted_rows_change_idx ON deleted_rows (change_seq, uid)",
+            "CREATE OR REPLACE FUNCTION stamp_change() RETURNS trigger AS $$ BEGIN "
+            "NEW.change_seq := txid_current(); RETURN NEW; END $$ LANGUAGE plpgsql",
+            "DROP TRIGGER IF EXISTS decks_change ON decks",
+            "CREATE TRIGGER decks_change BEFORE INSERT OR UPDATE ON decks FOR EACH ROW EXECUTE PROCEDURE stamp_change()",
+            "DROP TRIGGER IF EXISTS flashcards_change ON flashcards",
+            "CREATE TRIGGER flashcards_change BEFORE INSERT OR UPDATE ON flashcards FOR EACH ROW EXECUTE PROCEDURE stamp_change()",
+            "DROP TRIGGER IF EXISTS deleted_rows_change ON deleted_rows",
+            "CREATE TRIGGER deleted_rows_change BEFORE INSERT OR UPDATE ON deleted_rows FOR EACH ROW EXECUTE PROCEDURE stamp_change()",
+        }},
+        // The review queue pages on (due, card_id) with a millisecond QDateTime. A due with microseconds, as now()
+        // gives new cards, lies past the truncated cursor and came back on every page. The type rounds every
+        // write to milliseconds, existing values included.
+        {10, "review due in milliseconds", {
+            "ALTER TABLE review_state ALTER COLUMN due TYPE TIMESTAMPTZ(3)",
+        }},
+        // Nothing pages on the change times any more, change_seq took their place
+        {11, "drop change time indexes", {
+            "DROP INDEX IF EXISTS decks_updated_idx",
+            "DROP INDEX IF EXISTS flashcards_updated_idx",
+            "DROP INDEX IF EXISTS deleted_rows_deleted_idx",
+        }},
+    };
+    return migrations;
+}
+
+// Milliseconds since the epoch, SQLite has no clock function returning them directly
+#define SQLITE_NOW "CAST((julianday('now') - 2440587.5) * 86400000 AS INTEGER)"
+// Review times are stored as ISO 8601 text in UTC, which sorts in time order
+#define SQLITE_TIMESTAMP "strftime('%Y-%m-%dT%H:%M:%fZ', 'now')"
+
+const QVector<Migration> &sqliteSchemaMigrations()
+{
+    // AUTOINCREMENT keeps ids growing after deletes, the deck model and keyset paging rely on that
+    static const QVector<Migration> migrations = {
+        {1, "decks table", {
+            "CREATE TABLE IF NOT EXISTS decks ( id INTEGER PRIMARY KEY AUTOINCREMENT, name VARCHAR(255) NOT NULL )",
+        }},
+        {2, "flashcards table", {
+            "CREATE TABLE IF NOT EXISTS flashcards ( id INTEGER PRIMARY KEY AUTOINCREMENT, frontSide TEXT NOT NULL, backSide TEXT NOT NULL, deck_id INTEGER NOT NULL, FOREIGN KEY (deck_id) REFERENCES decks(id) ON DELETE CASCADE )",
+        }},
+        {3, "flashcards deck index", {
+            "CREATE INDEX IF NOT EXISTS flashcards_deck_id_idx ON flashcards (deck_id, id)",
+        }},
+        {4, "exercise cache", {
+            "CREATE TABLE IF NOT EXISTS exercise_cache ( id INTEGER PRIMARY KEY AUTOINCREMENT, card_id INTEGER NOT NULL, prompt_hash VARCHAR(64) NOT NULL, model VARCHAR(255) NOT NULL, card_hash VARCHAR(64) NOT NULL, sentence TEXT NOT NULL, served_count INTEGER NOT NULL DEFAULT 0, created_at TEXT NOT NULL DEFAULT (" SQLITE_TIMESTAMP "), FOREIGN KEY (card_id) REFERENCES flashcards(id) ON DELETE CASCADE )",
+            "CREATE INDEX IF NOT EXISTS exercise_cache_key_idx ON exercise_cache (card_id, prompt_hash, model)",
+            "CREATE INDEX IF NOT EXISTS exercise_cache_age_idx ON exercise_cache (created_at, id)",
+        }},
+        {5, "review state", {
+            "CREATE TABLE IF NOT EXISTS review_state ( card_id INTEGER PRIMARY KEY, deck_id INTEGER NOT NULL, due TEXT NOT NULL DEFAULT (" SQLITE_TIMESTAMP "), interval_days DOUBLE PRECISION NOT NULL DEFAULT 0, ease DOUBLE PRECISION NOT NULL DEFAULT 2.5, repetitions INTEGER NOT NULL DEFAULT 0, lapses INTEGER NOT NULL DEFAULT 0, FOREIGN KEY (card_id) REFERENCES flashcards(id) ON DELETE CASCADE )",
+            "CREATE INDEX IF NOT EXISTS review_state_deck_due_idx ON review_state (deck_id, due, card_id)",
+            "CREATE INDEX IF NOT EXISTS review_state_due_idx ON review_state (due, card_id)",
+            "CREATE TRIGGER IF NOT EXISTS flashcards_review_state AFTER INSERT ON flashcards BEGIN "
+            "INSERT OR IGNORE INTO review_state (card_id, deck_id) VALUES (NEW.id, NEW.deck_id); END",
+            "CREATE TRIGGER IF NOT EXISTS flashcards_review_deck AFTER UPDATE OF deck_id ON flashcards WHEN OLD.deck_id <> NEW.deck_id BEGIN "
+            "UPDATE review_state SET deck_id = NEW.deck_id WHERE card_id = NEW.id; END",
+            "INSERT OR IGNORE INTO review_state (card_id, deck_id) SELECT id, deck_id FROM flashcards",
+        }},
+        // Only the local process uses the file, there is nobody to notify
+        {6, "change notifications", {}},
+        // SQLite cannot add a column with a random default, new rows get their uid and time from a trigger
+        {7, "sync metadata", {
+            "ALTER TABLE decks ADD COLUMN uid TEXT",
+            "ALTER TABLE decks ADD COLUMN updated_at INTEGER NOT NULL DEFAULT 0",
+            "UPDATE decks SET uid = lower(hex(randomblob(16))), updated_at = " SQLITE_NOW,
+            "CREATE UNIQUE INDEX IF NOT EXISTS decks_uid_idx ON decks (uid)",
+            "CREATE INDEX IF NOT EXISTS decks_updated_idx ON decks (updated_at, uid)",
+            "ALTER TABLE flashcards ADD COLUMN uid TEXT",
+            "ALTER TABLE flashcards ADD COLUMN updated_at INTEGER NOT NULL DEFAULT 0",
+            "UPDATE flashcards SET uid = lower(hex(randomblob(16))), updated_at = " SQLITE_NOW,
+            "CREATE UNIQUE INDEX IF NOT EXISTS flashcards_uid_idx ON flashcards (uid)",
+            "CREATE INDEX IF NOT EXISTS flashcards_updated_idx ON flashcards (updated_at, uid)",
+            "CREATE TABLE IF NOT EXISTS deleted_rows ( uid TEXT PRIMARY KEY, table_name TEXT NOT NULL, deleted_at INTEGER NOT NULL )",
+            "CREATE INDEX IF NOT EXISTS deleted_rows_deleted_idx ON deleted_rows (deleted_at, uid)",
+            // How far the sync engine got in each direction
+            "CREATE TABLE IF NOT EXISTS sync_state ( name TEXT PRIMARY KEY, value INTEGER NOT NULL )",
+            "CREATE TRIGGER IF NOT EXISTS decks_stamp AFTER INSERT ON decks WHEN NEW.uid IS NULL OR NEW.updated_at = 0 BEGIN "
+            "UPDATE decks SET uid = COALESCE(NEW.uid, lower(hex(randomblob(16)))), updated_at = CASE WHEN NEW.updated_at = 0 THEN " SQLITE_NOW " ELSE NEW.updated_at END WHERE id = NEW.id; END",
+            "CREATE TRIGGER IF NOT EXISTS flashcards_stamp AFTER INSERT ON flashcards WHEN NEW.uid IS NULL OR NEW.updated_at = 0 BEGIN "
+            "UPDATE flashcards SET uid = COALESCE(NEW.uid, lower(hex(randomblob(16)))), updated_at = CASE WHEN NEW.updated_at = 0 THEN " SQLITE_NOW " ELSE NEW.updated_at END WHERE id = NEW.id; END",
+            "CREATE TRIGGER IF NOT EXISTS decks_touch AFTER UPDATE ON decks WHEN NEW.updated_at = OLD.updated_at BEGIN "
+            "UPDATE decks SET updated_at = " SQLITE_NOW " WHERE id = NEW.id; END",
+            "CREATE TRIGGER IF NOT EXISTS flashcards_touch AFTER UPDATE ON flashcards WHEN NEW.updated_at = OLD.updated_at BEGIN "
+            "UPDATE flashcards SET updated_at = " SQLITE_NOW " WHERE id = NEW.id; END",
+            "CREATE TRIGGER IF NOT EXISTS decks_deleted AFTER DELETE ON decks BEGIN "
+            "INSERT INTO deleted_rows (uid, table_name, deleted_at) VALUES (OLD.uid, 'decks', " SQLITE_NOW ") "
+            "ON CONFLICT (uid) DO UPDATE SET deleted_at = MAX(deleted_rows.deleted_at, excluded.deleted_at); END",
+            "CREATE TRIGGER IF NOT EXISTS flashcards_deleted AFTER DELETE ON flashcards BEGIN "
+            "INSERT INTO deleted_rows (uid, table_name, deleted_at) VALUES (OLD.uid, 'flashcards', " SQLITE_NOW ") "
+            "ON CONFLICT (uid) DO UPDATE SET deleted_at = MAX(deleted_rows.deleted_at, excluded.deleted_at); END",
+        }},
+        // The local backend searches an in-memory index kept current from the changed rows and deleted_rows
+        {8, "card search index", {}},
+        // One writer at a time, so a counter bumped by every write orders the changes as they commit.
+        // The triggers of migration 7 are replaced by ones that also take the next number; a write that
+        // only sets change_seq is the trigger's own and is not counted again.
+        {9, "change sequence", {
+            "CREATE TABLE IF NOT EXISTS change_counter ( value INTEGER NOT NULL )",
+            "INSERT INTO change_counter (value) VALUES (0)",
+            "ALTER TABLE decks ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS decks_change_idx ON decks (change_seq, uid)",
+            "ALTER TABLE flashcards ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS flashcards_change_idx ON flashcards (change_seq, uid)",
+            "ALTER TABLE deleted_rows ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 0",
+            "CREATE INDEX IF NOT EXISTS deleted_rows_change_idx ON deleted_rows (change_seq, uid)",
+            // Marks taken from updated_at mean nothing on the new cursor, the next sync starts from the beginning
+            "ALTER TABLE sync_state ADD COLUMN uid TEXT NOT NULL DEFAULT ''",
+            "DELETE FROM sync_state",
+            "DROP TRIGGER IF EXISTS decks_stamp",
+            "DROP TRIGGER IF EXISTS decks_touch",
+            "DROP TRIGGER IF EXISTS flashcards_stamp",
+            "DROP TRIGGER IF EXISTS flashcards_touch",
+            "CREATE TRIGGER decks_stamp AFTER INSERT ON decks BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE decks SET uid = COALESCE(NEW.uid, lower(hex(randomblob(16)))), updated_at = CASE WHEN NEW.updated_at = 0 THEN " SQLITE_NOW " ELSE NEW.updated_at END, "
+            "change_seq = (SELECT value FROM change_counter) WHERE id = NEW.id; END",
+            "CREATE TRIGGER flashcards_stamp AFTER INSERT ON flashcards BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE flashcards SET uid = COALESCE(NEW.uid, lower(hex(randomblob(16)))), updated_at = CASE WHEN NEW.updated_at = 0 THEN " SQLITE_NOW " ELSE NEW.updated_at END, "
+            "change_seq = (SELECT value FROM change_counter) WHERE id = NEW.id; END",
+            "CREATE TRIGGER deleted_rows_stamp AFTER INSERT ON deleted_rows BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE deleted_rows SET change_seq = (SELECT value FROM change_counter) WHERE uid = NEW.uid; END",
+            "CREATE TRIGGER decks_touch AFTER UPDATE ON decks WHEN NEW.change_seq = OLD.change_seq BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE decks SET updated_at = CASE WHEN NEW.updated_at = OLD.updated_at THEN " SQLITE_NOW " ELSE NEW.updated_at END, "
+            "change_seq = (SELECT value FROM change_counter) WHERE id = NEW.id; END",
+            "CREATE TRIGGER flashcards_touch AFTER UPDATE ON flashcards WHEN NEW.change_seq = OLD.change_seq BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE flashcards SET updated_at = CASE WHEN NEW.updated_at = OLD.updated_at THEN " SQLITE_NOW " ELSE NEW.updated_at END, "
+            "change_seq = (SELECT value FROM change_counter) WHERE id = NEW.id; END",
+            "CREATE TRIGGER deleted_rows_touch AFTER UPDATE ON deleted_rows WHEN NEW.change_seq = OLD.change_seq BEGIN UPDATE change_counter SET value = value + 1; "
+            "UPDATE deleted_rows SET change_seq = (SELECT value FROM change_counter) WHERE uid = NEW.uid; END",
+        }},
+        // Times are written with strftime('%f'), milliseconds already
+        {10, "review due in milliseconds", {}},
+        {11, "drop change time indexes", {
+            "DROP INDEX IF EXISTS decks_updated_idx",
+            "DROP INDEX IF EXISTS flashcards_updated_idx",
+            "DROP INDEX IF EXISTS deleted_rows_deleted_idx",
+        }},
+    };
+    return migrations;
+}
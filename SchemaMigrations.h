@@ -0,0 +1,28 @@
+#ifndef SCHEMAMIGRATIONS_H
+#define SCHEMAMIGRATIONS_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct Migration
+{
+    int version;
+    QString description;
+    QStringList statements;
+};
+
+// The database schema as ordered steps. DBManager::migrate applies the
+// steps newer than the version recorded in schema_version, once, at
+// startup. Every statement is idempotent, so databases created before
+// schema_version existed are brought up to date as well. New steps are
+// appended, existing ones are never edited.
+const QVector<Migration> &schemaMigrations();
+// The same schema for the embedded SQLite database, version for version.
+// Steps that only make sense on the server, such as LISTEN/NOTIFY
+// triggers, are empty here so the numbering stays aligned. An SQLite file
+// has had schema_version from the start, so these steps run exactly once
+// and need not be idempotent.
+const QVector<Migration> &sqliteSchemaMigrations();
+
+#endif // SCHEMAMIGRATIONS_H
@@ -0,0 +1,178 @@
+#include "ServerSupervisor.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTcpServer>
+#include <QDebug>
+
+// Readiness probing starts fast and backs off, the server gets this long before it counts as failed
+static const int firstProbeDelayMs = 50;
+static const int maxProbeDelayMs = 1000;
+static const int startupTimeoutMs = 30000;
+static const int maxRestarts = 5;
+
+ServerSupervisor::ServerSupervisor(const QString &pythonExecutable, const QString &scriptPath, QObject *parent)
+    : QObject(parent)
+    , pythonExecutable(pythonExecutable)
+    , scriptPath(scriptPath)
+    , process(new QProcess(this))
+    , manager(new QNetworkAccessManager(this))
+{
+    probeTimer.setSingleShot(true);
+    connect(&probeTimer, &QTimer::timeout, this, &ServerSupervisor::probe);
+
+    connect(process, &QProcess::readyReadStandardOutput, this, [this]() {
+        qDebug() << process->readAllStandardOutput();
+    });
+    connect(process, &QProcess::readyReadStandardError, this, [this]() {
+        qDebug() << process->readAllStandardError();
+    });
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            qDebug() << "Failed to start server.py:" << process->errorString();
+            emit failed(process->errorString());
+        }
+    });
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [this](int exitCode, QProcess::ExitStatus exitStatus) {
+        probeTimer.stop();
+        serverReady = false;
+        if (stopping) {
+            return;
+        }
+        qDebug() << "server.py exited unexpectedly, code" << exitCode << (exitStatus == QProcess::CrashExit ? "(crashed)" : "");
+        scheduleRestart();
+    });
+}
+
+QString ServerSupervisor::findScript()
+{
+    const QString appDir = QCoreApplication::applicationDirPath();
+    const QStringList candidates = {
+        QDir(appDir).filePath("server.py"),
+        QDir(appDir).filePath("../server.py"),
+        QDir(QDir::homePath()).filePath("Language_app_qt/server.py"),
+    };
+    for (const QString &candidate : candidates) {
+        if (QFileInfo::exists(candidate)) {
+            return QDir::cleanPath(candidate);
+        }
+    }
+    return QString();
+}
+
+int ServerSupervisor::pickFreePort()
+{
+    // Let the OS hand out an ephemeral port, released again right before the server binds it
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0)) {
+        return 0;
+    }
+    return server.serverPort();
+}
+
+void ServerSupervisor::start()
+{
+    stopping = false;
+    restarts = 0;
+    launch();
+}
+
+void ServerSupervisor::launch()
+{
+    port = pickFreePort();
+    if (port == 0) {
+        qDebug() << "No free port for server.py";
+        emit failed("no free port");
+        return;
+    }
+    serverReady = false;
+    startupClock.start();
+    probeDelayMs = firstProbeDelayMs;
+    // Non-blocking, readiness is detected by the probe
+    process->start(pythonExecutable, QStringList() << scriptPath << "--port" << QString::number(port));
+    probeTimer.start(probeDelayMs);
+}
+
+void ServerSupervisor::probe()
+{
+    if (process->state() == QProcess::NotRunning || stopping) {
+        return;
+    }
+    QNetworkRequest request(baseUrl().resolved(QUrl("/health")));
+    QNetworkReply *reply = manager->get(request);
+    QTimer::singleShot(maxProbeDelayMs, reply, &QNetworkReply::abort);
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        if (stopping || serverReady || process->state() == QProcess::NotRunning) {
+            return;
+        }
+        if (reply->error() == QNetworkReply::NoError) {
+            serverReady = true;
+            // Only crashes in a row count towards giving up, a server that came up starts over with the shortest delays
+            restarts = 0;
+            probeDelayMs = firstProbeDelayMs;
+            qDebug() << "server.py ready on port" << port << "after" << startupClock.elapsed() << "ms";
+            emit ready(baseUrl());
+            return;
+        }
+        if (startupClock.elapsed() > startupTimeoutMs) {
+            qDebug() << "server.py did not become ready within" << startupTimeoutMs << "ms";
+            process->kill();
+            return;
+        }
+        probeDelayMs = qMin(probeDelayMs * 2, maxProbeDelayMs);
+        probeTimer.start(probeDelayMs);
+    });
+}
+
+void ServerSupervisor::scheduleRestart()
+{
+    if (restarts >= maxRestarts) {
+        qDebug() << "server.py failed" << restarts << "times, giving up";
+        emit failed("too many restarts");
+        return;
+    }
+    // Back off between restarts so a server that dies on startup doesn't spin
+    const int delayMs = 500 << restarts;
+    restarts++;
+    qDebug() << "Restarting server.py in" << delayMs << "ms";
+    QTimer::singleShot(delayMs, this, [this]() {
+        if (!stopping) {
+            launch();
+        }
+    });
+}
+
+void ServerSupervisor::stop(int timeoutMs)
+{
+    stopping = true;
+    probeTimer.stop();
+    if (process->state() == QProcess::NotRunning) {
+        return;
+    }
+    QElapsedTimer clock;
+    clock.start();
+    // SIGTERM first, only our own process is ever signalled
+    process->terminate();
+    if (!process->waitForFinished(timeoutMs)) {
+        qDebug() << "server.py ignored SIGTERM, killing it";
+        process->kill();
+        process->waitForFinished(timeoutMs);
+    }
+    qDebug() << "server.py stopped in" << clock.elapsed() << "ms";
+}
+
+bool ServerSupervisor::isReady() const
+{
+    return serverReady;
+}
+
+QUrl ServerSupervisor::baseUrl() const
+{
+    return QUrl(QString("http://127.0.0.1:%1/").arg(port));
+}
@@ -0,0 +1,54 @@
+#ifndef SERVERSUPERVISOR_H
+#define SERVERSUPERVISOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QProcess>
+#include <QString>
+#include <QTimer>
+#include <QUrl>
+
+// Runs server.py as a child process on a free port. Readiness is probed
+// asynchronously with back-off, a crashed server is restarted (giving up
+// only after several crashes without becoming ready in between) and stop()
+// sends SIGTERM before falling back to a kill after a timeout.
+class ServerSupervisor : public QObject
+{
+    Q_OBJECT
+
+public:
+    ServerSupervisor(const QString &pythonExecutable, const QString &scriptPath, QObject *parent = nullptr);
+
+    void start();
+    void stop(int timeoutMs = 3000);
+    bool isReady() const;
+    QUrl baseUrl() const;
+
+    // First existing server.py among the usual install and checkout locations
+    static QString findScript();
+
+signals:
+    void ready(const QUrl &baseUrl);
+    void failed(const QString &reason);
+
+private:
+    void launch();
+    void probe();
+    void scheduleRestart();
+    static int pickFreePort();
+
+    QString pythonExecutable;
+    QString scriptPath;
+    QProcess *process;
+    QNetworkAccessManager *manager;
+    QTimer probeTimer;
+    QElapsedTimer startupClock;
+    int port = 0;
+    int probeDelayMs = 0;
+    int restarts = 0;
+    bool serverReady = false;
+    bool stopping = false;
+};
+
+#endif // SERVERSUPERVISOR_H
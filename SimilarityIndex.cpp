@@ -0,0 +1,246 @@
+#include "SimilarityIndex.h"
+
+#include <QSet>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "CardSearch.h"
+
+// The widest instruction set the compiler targets is used, SSE2 is part of every x86-64 build
+#if defined(__AVX__) && defined(__FMA__)
+#include <immintrin.h>
+#define SIMILARITY_AVX_FMA
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMILARITY_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMILARITY_NEON
+#endif
+
+// Bigrams say less about how a word looks than trigrams
+static const float bigramWeight = 0.5f;
+static const float trigramWeight = 1.0f;
+
+SimilarityIndex::SimilarityIndex(int deckId)
+    : deck(deckId) {}
+
+int SimilarityIndex::deckId() const
+{
+    return deck;
+}
+
+int SimilarityIndex::size() const
+{
+    return ids.size();
+}
+
+bool SimilarityIndex::contains(int cardId) const
+{
+    return rowById.contains(cardId);
+}
+
+static void addGram(QStringView gram, float weight, float *out)
+{
+    // The sign comes from another bit of the hash, so collisions cancel out on average instead of adding up
+    const uint hash = uint(qHash(gram, 0x9e3779b9u));
+    out[hash % SimilarityIndex::dimensions] += (hash & 0x80000000u) ? -weight : weight;
+}
+
+void SimilarityIndex::vectorize(const QString &text, float *out)
+{
+    std::fill(out, out + dimensions, 0.0f);
+    // Same words as the search index: case folded, accents dropped. Spaces mark the word boundaries,
+    // so "tion" at the end of a word is a different feature from "tion" inside one.
+    for (const QString &word : CardSearchIndex::tokenize(text))
+    {
+        const QString padded = ' ' + word + ' ';
+        for (int i = 0; i + 2 <= padded.size(); ++i)
+        {
+            addGram(QStringView(padded).mid(i, 2), bigramWeight, out);
+        }
+        for (int i = 0; i + 3 <= padded.size(); ++i)
+        {
+            addGram(QStringView(padded).mid(i, 3), trigramWeight, out);
+        }
+    }
+    const float norm = std::sqrt(dot(out, out));
+    if (norm > 0)
+    {
+        for (int i = 0; i < dimensions; ++i)
+        {
+            out[i] /= norm;
+        }
+    }
+}
+
+float SimilarityIndex::dot(const float *a, const float *b)
+{
+#if defined(SIMILARITY_AVX_FMA)
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    for (int i = 0; i < dimensions; i += 16)
+    {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    const __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+#elif defined(SIMILARITY_SSE2)
+    // Independent accumulators keep the adds from waiting on each other
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    __m128 sum3 = _mm_setzero_ps();
+    for (int i = 0; i < dimensions; i += 16)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(a + i + 8), _mm_loadu_ps(b + i + 8)));
+        sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+    }
+    __m128 sum = _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(SIMILARITY_NEON)
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    for (int i = 0; i < dimensions; i += 8)
+    {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    const float32x4_t sum = vaddq_f32(sum0, sum1);
+    return vgetq_lane_f32(sum, 0) + vgetq_lane_f32(sum, 1) + vgetq_lane_f32(sum, 2) + vgetq_lane_f32(sum, 3);
+#else
+    float sum = 0;
+    for (int i = 0; i < dimensions; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+void SimilarityIndex::add(int cardId, const QString &frontSide)
+{
+    int row = rowById.value(cardId, -1);
+    if (row < 0)
+    {
+        row = ids.size();
+        ids.append(cardId);
+        textHashes.append(0);
+        vectors.resize(vectors.size() + dimensions);
+        rowById.insert(cardId, row);
+    }
+    textHashes[row] = uint(qHash(frontSide));
+    vectorize(frontSide, vectors.data() + row * dimensions);
+}
+
+void SimilarityIndex::remove(int cardId)
+{
+    const int row = rowById.value(cardId, -1);
+    if (row < 0)
+    {
+        return;
+    }
+    // The last row takes the removed one's place, nothing else moves
+    const int last = ids.size() - 1;
+    if (row != last)
+    {
+        std::copy(vectors.constBegin() + last * dimensions, vectors.constBegin() + (last + 1) * dimensions, vectors.begin() + row * dimensions);
+        ids[row] = ids[last];
+        textHashes[row] = textHashes[last];
+        rowById.insert(ids[row], row);
+    }
+    ids.removeLast();
+    textHashes.removeLast();
+    vectors.resize(last * dimensions);
+    rowById.remove(cardId);
+}
+
+void SimilarityIndex::update(const CardStore &cards)
+{
+    QSet<int> present;
+    present.reserve(cards.size());
+    for (int i = 0; i < cards.size(); ++i)
+    {
+        const int cardId = cards.cardId(i);
+        present.insert(cardId);
+        const int row = rowById.value(cardId, -1);
+        const QString frontSide = cards.frontSide(i);
+        if (row < 0 || textHashes.at(row) != uint(qHash(frontSide)))
+        {
+            add(cardId, frontSide);
+        }
+    }
+    const QVector<int> known = ids;
+    for (int cardId : known)
+    {
+        if (!present.contains(cardId))
+        {
+            remove(cardId);
+        }
+    }
+}
+
+QVector<QPair<int, float>> SimilarityIndex::nearest(int cardId, int k) const
+{
+    const int row = rowById.value(cardId, -1);
+    if (row < 0)
+    {
+        return QVector<QPair<int, float>>();
+    }
+    return nearest(vectors.constData() + row * dimensions, k, cardId);
+}
+
+QVector<QPair<int, float>> SimilarityIndex::nearest(const QString &text, int k, int excludeCardId) const
+{
+    QVector<float> query(dimensions);
+    vectorize(text, query.data());
+    return nearest(query.constData(), k, excludeCardId);
+}
+
+QVector<QPair<int, float>> SimilarityIndex::nearest(const float *query, int k, int excludeCardId) const
+{
+    QVector<QPair<int, float>> result;
+    if (k <= 0)
+    {
+        return result;
+    }
+    // Min-heap of the k best so far, a row only has to beat its top
+    using Candidate = std::pair<float, int>;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> best;
+    const float *row = vectors.constData();
+    for (int i = 0; i < ids.size(); ++i, row += dimensions)
+    {
+        if (ids.at(i) == excludeCardId)
+        {
+            continue;
+        }
+        const float similarity = dot(query, row);
+        if (int(best.size()) < k)
+        {
+            best.push(Candidate(similarity, ids.at(i)));
+        }
+        else if (similarity > best.top().first)
+        {
+            best.pop();
+            best.push(Candidate(similarity, ids.at(i)));
+        }
+    }
+    result.resize(int(best.size()));
+    for (int i = result.size() - 1; i >= 0; --i)
+    {
+        result[i] = qMakePair(best.top().second, best.top().first);
+        best.pop();
+    }
+    return result;
+}
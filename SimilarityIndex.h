@@ -0,0 +1,54 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include "CardStore.h"
+
+// Character n-gram vectors of a deck's front sides, for finding the cards
+// that look most like a given one. Every front is hashed into a fixed-size
+// vector of its letter bigrams and trigrams (signed feature hashing) and
+// normalized, so the cosine similarity of two cards is a dot product. The
+// vectors sit back to back in one array and a query is a linear scan with
+// a SIMD dot product and a small top-k heap, a few microseconds per
+// thousand cards. Cards are added, re-vectorized and dropped one at a time,
+// so a card change touches one row; update() compares a whole CardStore
+// and is only needed when the changed cards are not known.
+class SimilarityIndex
+{
+public:
+    // Floats per vector, a multiple of the widest SIMD register used
+    static const int dimensions = 128;
+
+    explicit SimilarityIndex(int deckId = -1);
+
+    int deckId() const;
+    int size() const;
+    bool contains(int cardId) const;
+    // Vectorizes cards that are new or whose front changed and drops cards no longer in the store
+    void update(const CardStore &cards);
+    void add(int cardId, const QString &frontSide);
+    void remove(int cardId);
+
+    // Up to k other cards most similar to cardId, most similar first, with their cosine similarity
+    QVector<QPair<int, float>> nearest(int cardId, int k) const;
+    QVector<QPair<int, float>> nearest(const QString &text, int k, int excludeCardId = -1) const;
+
+    // Normalized n-gram vector of text into out, which holds dimensions floats
+    static void vectorize(const QString &text, float *out);
+    static float dot(const float *a, const float *b);
+
+private:
+    QVector<QPair<int, float>> nearest(const float *query, int k, int excludeCardId) const;
+
+    int deck;
+    // dimensions floats per card, row i belongs to ids[i]
+    QVector<float> vectors;
+    QVector<int> ids;
+    QVector<uint> textHashes;
+    QHash<int, int> rowById;
+};
+
+#endif // SIMILARITYINDEX_H
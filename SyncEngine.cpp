@@ -0,0 +1,349 @@
+#include "SyncEngine.h"
+
+#include <QSet>
+#include <QStringList>
+#include <functional>
+
+// Rows changed after a (change_seq, uid) position and before the source's change horizon. The change
+// sequence is always the last column and stays behind, the copies get their own on the target.
+static const char *selectDecks = "SELECT uid, name, updated_at, change_seq FROM decks "
+                                 "WHERE (change_seq, uid) > (?, ?) AND change_seq < ? ORDER BY change_seq, uid LIMIT ?";
+static const char *selectFlashcards = "SELECT f.uid, d.uid, f.frontSide, f.backSide, f.updated_at, f.change_seq FROM flashcards f JOIN decks d ON d.id = f.deck_id "
+                                      "WHERE (f.change_seq, f.uid) > (?, ?) AND f.change_seq < ? ORDER BY f.change_seq, f.uid LIMIT ?";
+static const char *selectDeletions = "SELECT uid, table_name, deleted_at, change_seq FROM deleted_rows "
+                                     "WHERE (change_seq, uid) > (?, ?) AND change_seq < ? ORDER BY change_seq, uid LIMIT ?";
+
+// VALUES rows for a CTE; the casts give Postgres the parameter types and mean the same to SQLite
+static QString valuesList(int rows, const QString &row)
+{
+    QStringList list;
+    for (int i = 0; i < rows; ++i)
+    {
+        list.append(row);
+    }
+    return list.join(", ");
+}
+
+struct Mark
+{
+    qint64 changeSeq = 0;
+    QString uid;
+};
+
+static Mark readMark(DBManager &local, const QString &name)
+{
+    Mark mark;
+    PooledQuery query = local.executeQuery("SELECT value, uid FROM sync_state WHERE name = ?", QVariantList() << name);
+    if (query.next())
+    {
+        mark.changeSeq = query.value(0).toLongLong();
+        mark.uid = query.value(1).toString();
+    }
+    return mark;
+}
+
+static bool writeMark(DBManager &local, const QString &name, const Mark &mark)
+{
+    PooledQuery query = local.executeQuery("INSERT INTO sync_state (name, value, uid) VALUES (?, ?, ?) "
+                                         "ON CONFLICT (name) DO UPDATE SET value = excluded.value, uid = excluded.uid",
+                                         QVariantList() << name << mark.changeSeq << mark.uid);
+    return query.lastError().type() == QSqlError::NoError;
+}
+
+// Applies rows read from the source to the target, returns the target rows changed or -1 on failure
+using Apply = std::function<int(DBManager &target, int rows, const QVariantList &values)>;
+
+// How many of the batch's leading rows the target can take now, -1 on failure. Rows after the
+// first one that has to wait stay behind the mark and are read again on the next round.
+using Ready = std::function<int(DBManager &target, int rows, const QVariantList &values)>;
+
+// One batch in a transaction of its own. On Postgres the per-row card notifications are
+// suppressed the way an import does it, sync() sends one for the whole round.
+static int applyBatch(DBManager &target, const Apply &apply, int rows, const QVariantList &values)
+{
+    if (target.isSqlite())
+    {
+        return apply(target, rows, values);
+    }
+    if (!target.beginTransaction())
+    {
+        return -1;
+    }
+    target.executeQuery("SET LOCAL flashcards.bulk_import = 'on'");
+    const int applied = apply(target, rows, values);
+    if (applied < 0 || !target.commitTransaction())
+    {
+        target.rollbackTransaction();
+        return -1;
+    }
+    return applied;
+}
+
+// Copies the rows changed since the mark from source to target a batch at a time and advances
+// the mark after every batch, so an interrupted round resumes where it stopped
+static int transfer(DBManager &local, DBManager &source, DBManager &target, const QString &markName, const QString &select, int columns, int batchSize, const Apply &apply, const Ready &ready)
+{
+    const qint64 horizon = source.changeHorizon();
+    if (horizon < 0)
+    {
+        return -1;
+    }
+    Mark mark = readMark(local, markName);
+    int changed = 0;
+    for (;;)
+    {
+        PooledQuery query = source.executeQuery(select, QVariantList() << mark.changeSeq << mark.uid << horizon << batchSize);
+        if (query.lastError().type() != QSqlError::NoError)
+        {
+            return -1;
+        }
+        QVariantList values;
+        QVector<Mark> marks;
+        while (query.next())
+        {
+            for (int column = 0; column < columns; ++column)
+            {
+                values << query.value(column);
+            }
+            Mark row;
+            row.uid = query.value(0).toString();
+            row.changeSeq = query.value(columns).toLongLong();
+            marks.append(row);
+        }
+        int rows = marks.size();
+        if (rows == 0)
+        {
+            break;
+        }
+        const int read = rows;
+        if (ready)
+        {
+            rows = ready(target, rows, values);
+            if (rows < 0)
+            {
+                return -1;
+            }
+            if (rows < read)
+            {
+                qDebug() << "Sync of" << markName << "waits at" << marks.at(rows).uid << "until the rows it depends on arrive";
+                if (rows == 0)
+                {
+                    break;
+                }
+                values = values.mid(0, rows * columns);
+            }
+        }
+        mark = marks.at(rows - 1);
+        const int applied = applyBatch(target, apply, rows, values);
+        if (applied < 0 || !writeMark(local, markName, mark))
+        {
+            return -1;
+        }
+        changed += applied;
+        if (rows < batchSize)
+        {
+            break;
+        }
+    }
+    return changed;
+}
+
+static int affected(QSqlQuery query, const char *what)
+{
+    if (query.lastError().type() != QSqlError::NoError)
+    {
+        qDebug() << "Failed to sync" << what << ":" << query.lastError().text();
+        return -1;
+    }
+    return qMax(0, query.numRowsAffected());
+}
+
+// Inserts decks the target doesn't have and overwrites older ones. A deck deleted on the
+// target after the change being copied stays deleted.
+static int applyDecks(DBManager &target, int rows, const QVariantList &values)
+{
+    return affected(target.executeQuery("WITH v(uid, name, updated_at) AS (VALUES " + valuesList(rows, "(CAST(? AS TEXT), CAST(? AS TEXT), CAST(? AS BIGINT))") + ") "
+                                        "INSERT INTO decks (uid, name, updated_at) SELECT uid, name, updated_at FROM v "
+                                        "WHERE NOT EXISTS (SELECT 1 FROM deleted_rows t WHERE t.uid = v.uid AND t.deleted_at >= v.updated_at) "
+                                        "ON CONFLICT (uid) DO UPDATE SET name = excluded.name, updated_at = excluded.updated_at WHERE decks.updated_at < excluded.updated_at",
+                                        values), "decks");
+}
+
+// Same for cards, whose deck is found by its uid since ids differ between the databases
+static int applyFlashcards(DBManager &target, int rows, const QVariantList &values)
+{
+    return affected(target.executeQuery("WITH v(uid, deck_uid, front, back, updated_at) AS (VALUES "
+                                        + valuesList(rows, "(CAST(? AS TEXT), CAST(? AS TEXT), CAST(? AS TEXT), CAST(? AS TEXT), CAST(? AS BIGINT))") + ") "
+                                        "INSERT INTO flashcards (uid, deck_id, frontSide, backSide, updated_at) SELECT v.uid, d.id, v.front, v.back, v.updated_at "
+                                        "FROM v JOIN decks d ON d.uid = v.deck_uid "
+                                        "WHERE NOT EXISTS (SELECT 1 FROM deleted_rows t WHERE t.uid = v.uid AND t.deleted_at >= v.updated_at) "
+                                        "ON CONFLICT (uid) DO UPDATE SET deck_id = excluded.deck_id, frontSide = excluded.frontSide, backSide = excluded.backSide, updated_at = excluded.updated_at "
+                                        "WHERE flashcards.updated_at < excluded.updated_at",
+                                        values), "flashcards");
+}
+
+// Cards up to the first one whose deck the target neither has nor has deleted. Such a deck
+// changed after the decks were read this round, the card would be dropped by the join above.
+static int flashcardsReady(DBManager &target, int rows, const QVariantList &values)
+{
+    QVariantList deckUids;
+    for (int row = 0; row < rows; ++row)
+    {
+        const QVariant deckUid = values.at(row * 5 + 1);
+        if (!deckUids.contains(deckUid))
+        {
+            deckUids << deckUid;
+        }
+    }
+    PooledQuery query = target.executeQuery("WITH v(uid) AS (VALUES " + valuesList(deckUids.size(), "(CAST(? AS TEXT))") + ") "
+                                            "SELECT v.uid FROM v WHERE EXISTS (SELECT 1 FROM decks d WHERE d.uid = v.uid) "
+                                            "OR EXISTS (SELECT 1 FROM deleted_rows t WHERE t.uid = v.uid)",
+                                            deckUids);
+    if (query.lastError().type() != QSqlError::NoError)
+    {
+        qDebug() << "Failed to look up the decks of synced flashcards:" << query.lastError().text();
+        return -1;
+    }
+    QSet<QString> known;
+    while (query.next())
+    {
+        known.insert(query.value(0).toString());
+    }
+    for (int row = 0; row < rows; ++row)
+    {
+        if (!known.contains(values.at(row * 5 + 1).toString()))
+        {
+            return row;
+        }
+    }
+    return rows;
+}
+
+// Records the tombstones and deletes the rows not changed since they were deleted elsewhere
+static int applyDeletions(DBManager &target, int rows, const QVariantList &values)
+{
+    const QString deleted = "WITH v(uid, table_name, deleted_at) AS (VALUES " + valuesList(rows, "(CAST(? AS TEXT), CAST(? AS TEXT), CAST(? AS BIGINT))") + ") ";
+    const int tombstones = affected(target.executeQuery(deleted + "INSERT INTO deleted_rows (uid, table_name, deleted_at) SELECT uid, table_name, deleted_at FROM v WHERE true "
+                                                        "ON CONFLICT (uid) DO UPDATE SET deleted_at = excluded.deleted_at WHERE deleted_rows.deleted_at < excluded.deleted_at",
+                                                        values), "deletions");
+    if (tombstones < 0)
+    {
+        return -1;
+    }
+    const int cards = affected(target.executeQuery(deleted + "DELETE FROM flashcards WHERE EXISTS (SELECT 1 FROM v WHERE v.uid = flashcards.uid "
+                                                   "AND v.table_name = 'flashcards' AND v.deleted_at >= flashcards.updated_at)", values), "deleted flashcards");
+    const int decks = affected(target.executeQuery(deleted + "DELETE FROM decks WHERE EXISTS (SELECT 1 FROM v WHERE v.uid = decks.uid "
+                                                   "AND v.table_name = 'decks' AND v.deleted_at >= decks.updated_at)", values), "deleted decks");
+    if (cards < 0 || decks < 0)
+    {
+        return -1;
+    }
+    return cards + decks;
+}
+
+SyncResult SyncEngine::sync(DBManager &local, DBManager &remote, int batchSize)
+{
+    SyncResult result;
+    // Decks go first so the cards copied next find theirs
+    struct Step
+    {
+        const char *mark;
+        const char *select;
+        int columns;
+        Apply apply;
+        Ready ready;
+    };
+    const QVector<Step> steps = {
+        {"decks", selectDecks, 3, applyDecks, nullptr},
+        {"flashcards", selectFlashcards, 5, applyFlashcards, flashcardsReady},
+        {"deleted", selectDeletions, 3, applyDeletions, nullptr},
+    };
+    for (const Step &step : steps)
+    {
+        const int pushed = transfer(local, local, remote, QString("push_") + step.mark, step.select, step.columns, batchSize, step.apply, step.ready);
+        if (pushed < 0)
+        {
+            return result;
+        }
+        result.pushed += pushed;
+    }
+    if (result.pushed > 0 && !remote.isSqlite())
+    {
+        // Clients listening on the server reload their cards once for the whole push
+        remote.executeQuery("SELECT pg_notify('flashcard_changes', json_build_object('op', 'SYNC')::text)");
+    }
+    for (const Step &step : steps)
+    {
+        const int pulled = transfer(local, remote, local, QString("pull_") + step.mark, step.select, step.columns, batchSize, step.apply, step.ready);
+        if (pulled < 0)
+        {
+            return result;
+        }
+        result.pulled += pulled;
+    }
+    result.ok = true;
+    return result;
+}
+
+SyncEngine::SyncEngine(const DBManager &local, const DBManager &remote, QObject *parent)
+    : QObject(parent), worker(new AsyncDBManager(local, this)), remote(remote), remoteMigrated(QSharedPointer<bool>::create(false))
+{
+    timer.setInterval(30000);
+    connect(&timer, &QTimer::timeout, this, &SyncEngine::syncNow);
+}
+
+void SyncEngine::setInterval(int intervalMs)
+{
+    timer.setInterval(qMax(1000, intervalMs));
+}
+
+void SyncEngine::setBatchSize(int rows)
+{
+    batchSize = qMax(1, rows);
+}
+
+void SyncEngine::start()
+{
+    timer.start();
+    syncNow();
+}
+
+void SyncEngine::syncNow()
+{
+    if (running)
+    {
+        return;
+    }
+    running = true;
+    DBManager server = remote;
+    const int rows = batchSize;
+    QSharedPointer<bool> migrated = remoteMigrated;
+    worker->run([server, rows, migrated](DBManager &local) mutable {
+        // Both connections live on the worker thread, a server that is down costs this thread a connect timeout
+        if (!server.connect())
+        {
+            return SyncResult();
+        }
+        if (!*migrated)
+        {
+            *migrated = server.migrate();
+            if (!*migrated)
+            {
+                return SyncResult();
+            }
+        }
+        return sync(local, server, rows);
+    }, this, [this](const SyncResult &result) {
+        running = false;
+        if (!result.ok)
+        {
+            qDebug() << "Sync with the server did not complete, retrying in" << timer.interval() / 1000 << "s";
+            return;
+        }
+        if (result.pushed > 0 || result.pulled > 0)
+        {
+            qDebug() << "Synced with the server:" << result.pushed << "rows pushed," << result.pulled << "rows pulled";
+        }
+        emit synced(result.pushed, result.pulled);
+    });
+}
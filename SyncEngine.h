@@ -0,0 +1,59 @@
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include "AsyncDBManager.h"
+#include "DBManager.h"
+
+struct SyncResult
+{
+    bool ok = false;
+    int pushed = 0;
+    int pulled = 0;
+};
+
+// Keeps the embedded SQLite database and the shared Postgres database in
+// step while the application works on the local file. On a timer it copies
+// the decks, cards and deletions changed since the last run from one side
+// to the other, a batch of rows per statement, on a thread of its own. A
+// row changed on both sides keeps the change with the later updated_at
+// (last writer wins, so the clocks of the machines involved should agree).
+// Which rows changed is found from the order the changes were committed in,
+// so a change made offline and pushed hours later still reaches everyone.
+// When Postgres can't be reached the round is skipped and tried again on
+// the next tick. Review state and cached exercises stay local.
+class SyncEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Runs on its own thread with its own connections to both databases
+    SyncEngine(const DBManager &local, const DBManager &remote, QObject *parent = nullptr);
+
+    void setInterval(int intervalMs);
+    void setBatchSize(int rows);
+    // Syncs right away and then every interval
+    void start();
+    // Starts a round now unless one is running
+    void syncNow();
+
+    // One round on the calling thread: local changes are pushed first, then remote ones pulled
+    static SyncResult sync(DBManager &local, DBManager &remote, int batchSize);
+
+signals:
+    // pulled counts the local rows that changed, views showing them have to reload
+    void synced(int pushed, int pulled);
+
+private:
+    AsyncDBManager *worker;
+    DBManager remote;
+    QTimer timer;
+    int batchSize = 500;
+    bool running = false;
+    // Only touched on the worker thread
+    QSharedPointer<bool> remoteMigrated;
+};
+
+#endif // SYNCENGINE_H
@@ -0,0 +1,98 @@
+#include "SyntheticData.h"
+
+#include <QStringList>
+
+// Rows per INSERT, a few thousand parameters stay below every driver's limit
+static const int batchSize = 500;
+
+static const char *const syllables[] = {
+    "ka", "lo", "mi", "ne", "ta", "ri", "so", "vu", "be", "da", "fi", "go", "ha", "je", "ku", "la",
+    "ma", "no", "pe", "qu", "ra", "se", "ti", "wo", "xa", "yo", "zu", "ang", "ell", "ion", "ost", "ung",
+};
+static const int syllableCount = int(sizeof(syllables) / sizeof(syllables[0]));
+
+SyntheticData::SyntheticData(quint32 seed)
+    : random(seed) {}
+
+QString SyntheticData::word()
+{
+    QString word;
+    const int length = 1 + random.bounded(4);
+    for (int i = 0; i < length; ++i)
+    {
+        word += syllables[random.bounded(syllableCount)];
+    }
+    return word;
+}
+
+FlashcardRecord SyntheticData::card()
+{
+    FlashcardRecord card;
+    card.frontSide = word();
+    QStringList back;
+    const int words = 1 + random.bounded(3);
+    for (int i = 0; i < words; ++i)
+    {
+        back.append(word());
+    }
+    card.backSide = back.join(' ');
+    return card;
+}
+
+bool SyntheticData::addDecks(DBManager &dbManager, const QString &prefix, int count)
+{
+    if (!dbManager.beginTransaction())
+    {
+        return false;
+    }
+    for (int first = 0; first < count; first += batchSize)
+    {
+        const int rows = qMin(batchSize, count - first);
+        QStringList placeholders;
+        QVariantList names;
+        for (int i = 0; i < rows; ++i)
+        {
+            placeholders.append("(?)");
+            names << prefix + QString::number(first + i + 1);
+        }
+        PooledQuery query = dbManager.executeQuery("INSERT INTO decks (name) VALUES " + placeholders.join(", "), names);
+        if (query.lastError().type() != QSqlError::NoError)
+        {
+            qDebug() << "Failed to add synthetic decks:" << query.lastError().text();
+            dbManager.rollbackTransaction();
+            return false;
+        }
+    }
+    return dbManager.commitTransaction();
+}
+
+int SyntheticData::addDeck(DBManager &dbManager, const QString &name, int count)
+{
+    if (!dbManager.beginTransaction())
+    {
+        return -1;
+    }
+    const int deckId = dbManager.addDeck(name);
+    if (deckId < 0)
+    {
+        dbManager.rollbackTransaction();
+        return -1;
+    }
+    QVector<FlashcardRecord> batch;
+    batch.reserve(batchSize);
+    for (int added = 0; added < count; added += batch.size())
+    {
+        batch.clear();
+        const int rows = qMin(batchSize, count - added);
+        for (int i = 0; i < rows; ++i)
+        {
+            batch.append(card());
+        }
+        if (!dbManager.insertFlashcards(deckId, batch))
+        {
+            dbManager.rollbackTransaction();
+            return -1;
+        }
+    }
+    return dbManager.commitTransaction() ? deckId : -1;
+}
@@ -0,0 +1,31 @@
+#ifndef SYNTHETICDATA_H
+#define SYNTHETICDATA_H
+
+#include <QRandomGenerator>
+#include <QString>
+#include "DBManager.h"
+
+// Made-up decks and cards for benchmarks and for trying the application
+// with a large collection. Words are strung together from syllables, so
+// fronts vary in length and share beginnings the way vocabulary does, and
+// the same seed always produces the same data. Rows go in with multi-row
+// INSERTs inside one transaction per call, a million cards take seconds.
+class SyntheticData
+{
+public:
+    explicit SyntheticData(quint32 seed = 1);
+
+    QString word();
+    // A front word and a back side of one to three words
+    FlashcardRecord card();
+
+    // Adds count empty decks named prefix plus a running number
+    bool addDecks(DBManager &dbManager, const QString &prefix, int count);
+    // Adds a deck holding count cards, returns its id or -1 on failure
+    int addDeck(DBManager &dbManager, const QString &name, int count);
+
+private:
+    QRandomGenerator random;
+};
+
+#endif // SYNTHETICDATA_H
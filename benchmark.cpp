@@ -0,0 +1,369 @@
+// Measures the database and exercise paths the window depends on and writes
+// one JSON object per benchmark and size to stdout (or appends to --output),
+// so results of different runs can be compared line by line.
+//
+// By default the data lives in a scratch SQLite file that is deleted on exit.
+// With --backend postgres the database given is used and must hold nothing
+// but benchmark data: it has to be empty, or --reset clears it first.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "CardSampler.h"
+#include "DBManager.h"
+#include "DeckModel.h"
+#include "LLMClient.h"
+#include "ServerSupervisor.h"
+#include "SyntheticData.h"
+
+#ifndef BENCH_MOCK_SERVER
+#define BENCH_MOCK_SERVER "mock_server.py"
+#endif
+
+// Every benchmark runs at least this often, however long one run takes
+static const int minIterations = 3;
+// Cards drawn per sample, about what one refill of the exercise queue asks for
+static const int sampleCount = 10;
+
+// Where the results go and what every line is tagged with
+struct Report
+{
+    QFile *out = nullptr;
+    QString backend;
+    QString started;
+
+    void write(const QString &benchmark, qint64 size, QVector<qint64> samples, int errors = 0) const
+    {
+        if (samples.isEmpty())
+        {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        qint64 total = 0;
+        for (qint64 sample : samples)
+        {
+            total += sample;
+        }
+        const int n = samples.size();
+        QJsonObject line;
+        line["benchmark"] = benchmark;
+        line["backend"] = backend;
+        line["size"] = size;
+        line["iterations"] = n;
+        line["errors"] = errors;
+        line["min_ns"] = samples.first();
+        line["median_ns"] = samples.at(n / 2);
+        line["p95_ns"] = samples.at(qMin(n - 1, int(std::ceil(n * 0.95)) - 1));
+        line["mean_ns"] = total / n;
+        line["started"] = started;
+        out->write(QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n');
+        out->flush();
+    }
+};
+
+// Budget for one benchmark at one size
+struct Limits
+{
+    int maxIterations = 1000;
+    qint64 budgetMs = 3000;
+};
+
+// Runs body once untimed, so statements are prepared and caches warm, then until it ran
+// maxIterations times or the budget is used up, but at least minIterations times
+static QVector<qint64> measure(const Limits &limits, const std::function<void()> &body)
+{
+    body();
+    QVector<qint64> samples;
+    QElapsedTimer total;
+    total.start();
+    QElapsedTimer clock;
+    while (samples.size() < limits.maxIterations && (samples.size() < minIterations || total.elapsed() < limits.budgetMs))
+    {
+        clock.start();
+        body();
+        samples.append(clock.nsecsElapsed());
+    }
+    return samples;
+}
+
+static QVector<int> parseSizes(const QString &list)
+{
+    QVector<int> sizes;
+    for (const QString &size : list.split(',', Qt::SkipEmptyParts))
+    {
+        const int value = size.trimmed().toInt();
+        if (value > 0)
+        {
+            sizes.append(value);
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+// Deck grid population: the first page the window shows on startup, and every page as when
+// scrolling to the end. Pages are fetched synchronously here, the window gets them from its worker.
+static bool benchmarkDeckGrid(DBManager &db, SyntheticData &data, const Report &report, const Limits &limits, const QVector<int> &sizes, int pageSize)
+{
+    int seeded = 0;
+    for (int size : sizes)
+    {
+        QElapsedTimer clock;
+        clock.start();
+        if (!data.addDecks(db, "bench deck ", size - seeded))
+        {
+            return false;
+        }
+        report.write("seed.decks", size - seeded, QVector<qint64>() << clock.nsecsElapsed());
+        seeded = size;
+
+        DeckModel model;
+        model.setPageLoader([&db](int afterId, int limit, std::function<void(const QVector<QPair<int, QString>> &)> onPage) {
+            onPage(db.fetchDecksPage(afterId, limit));
+        }, pageSize);
+        report.write("deckGrid.firstPage", size, measure(limits, [&]() {
+            model.setDecks(db.fetchDecksPage(0, pageSize));
+        }));
+        int rows = 0;
+        report.write("deckGrid.allPages", size, measure(limits, [&]() {
+            model.setDecks(db.fetchDecksPage(0, pageSize));
+            while (model.canFetchMore(QModelIndex()))
+            {
+                model.fetchMore(QModelIndex());
+            }
+            rows = model.rowCount();
+        }));
+        if (rows != size)
+        {
+            qDebug() << "Deck grid held" << rows << "decks instead of" << size;
+        }
+    }
+    return true;
+}
+
+static bool benchmarkCards(DBManager &db, SyntheticData &data, const Report &report, const Limits &limits, const QVector<int> &sizes)
+{
+    QRandomGenerator random(42);
+    for (int size : sizes)
+    {
+        QElapsedTimer clock;
+        clock.start();
+        const int deckId = data.addDeck(db, QString("bench cards %1").arg(size), size);
+        if (deckId < 0)
+        {
+            return false;
+        }
+        report.write("seed.flashcards", size, QVector<qint64>() << clock.nsecsElapsed());
+        qDebug() << "Seeded" << size << "cards in" << clock.elapsed() << "ms";
+        const QPair<int, int> range = db.fetchFlashcardIdRange(deckId);
+
+        // A prepared point lookup, the shape of most of the application's queries
+        int errors = 0;
+        const QVector<qint64> lookups = measure(limits, [&]() {
+            PooledQuery query = db.executeQuery("SELECT frontSide, backSide FROM flashcards WHERE id = ?",
+                                              QVariantList() << random.bounded(range.first, range.second + 1));
+            if (!query.next())
+            {
+                errors++;
+            }
+        });
+        report.write("executeQuery", size, lookups, errors);
+
+        errors = 0;
+        const QVector<qint64> inserts = measure(limits, [&]() {
+            const FlashcardRecord card = data.card();
+            if (db.addFlashcard(deckId, card.frontSide, card.backSide) < 0)
+            {
+                errors++;
+            }
+        });
+        report.write("addFlashcard", size, inserts, errors);
+
+        // The whole deck read row by row, as loading it for the flashcard view does
+        errors = 0;
+        const QVector<qint64> reads = measure(limits, [&]() {
+            PooledQuery query = db.fetchFlashcards(deckId);
+            int rows = 0;
+            while (query.next())
+            {
+                rows++;
+            }
+            if (rows < size)
+            {
+                errors++;
+            }
+        });
+        report.write("fetchFlashcards", size, reads, errors);
+
+        CardSampler sampler(deckId);
+        errors = 0;
+        const QVector<qint64> draws = measure(limits, [&]() {
+            if (sampler.sample(db, sampleCount).isEmpty())
+            {
+                errors++;
+            }
+        });
+        report.write("CardSampler.sample", size, draws, errors);
+    }
+    return true;
+}
+
+// The promptOllama round trip: the request built, sent through LLMClient to the mock
+// server on localhost and the reply parsed. The mock answers at once unless given latency.
+static bool benchmarkPrompt(const Report &report, const Limits &limits, const QString &pythonExecutable, const QString &scriptPath)
+{
+    ServerSupervisor supervisor(pythonExecutable, scriptPath);
+    QUrl baseUrl;
+    {
+        QEventLoop loop;
+        QObject::connect(&supervisor, &ServerSupervisor::ready, &loop, [&baseUrl, &loop](const QUrl &url) {
+            baseUrl = url;
+            loop.quit();
+        });
+        QObject::connect(&supervisor, &ServerSupervisor::failed, &loop, &QEventLoop::quit);
+        QTimer::singleShot(30000, &loop, &QEventLoop::quit);
+        supervisor.start();
+        loop.exec();
+    }
+    if (!supervisor.isReady())
+    {
+        qDebug() << "Mock server" << scriptPath << "did not start, skipping the prompt benchmark";
+        return false;
+    }
+
+    LLMClient client(QList<QUrl>() << baseUrl);
+    QObject context;
+    SyntheticData data(7);
+    int errors = 0;
+    const QVector<qint64> roundTrips = measure(limits, [&]() {
+        const FlashcardRecord card = data.card();
+        QJsonObject json;
+        json["front_side"] = card.frontSide;
+        json["back_side"] = card.backSide;
+        json["model"] = "llama3";
+        QEventLoop loop;
+        QString response;
+        bool answered = false;
+        client.post("/prompt/", json, LLMClient::Interactive, &context, [&](const QByteArray &responseData) {
+            response = QJsonDocument::fromJson(responseData).object().value("response").toString();
+            answered = true;
+            loop.quit();
+        });
+        if (!answered)
+        {
+            QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+            loop.exec();
+        }
+        if (!answered)
+        {
+            // Calls back with an empty reply while loop still exists
+            client.cancel(&context);
+        }
+        if (response.isEmpty())
+        {
+            errors++;
+        }
+    });
+    report.write("promptOllama", 1, roundTrips, errors);
+    supervisor.stop();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("Language_app_qt_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the flashcard database and exercise paths, one JSON line per result.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"backend", "sqlite (a scratch file) or postgres.", "name", "sqlite"},
+        {"host", "Postgres host.", "host", "localhost"},
+        {"database", "Postgres database, only for benchmark data.", "name", "flashcards_bench"},
+        {"user", "Postgres user.", "user", "postgres"},
+        {"port", "Postgres port.", "port", "5432"},
+        {"reset", "Delete every deck, card and tombstone of the database first."},
+        {"cards", "Deck sizes for the card benchmarks.", "list", "1000,100000,1000000"},
+        {"decks", "Deck counts for the deck grid benchmarks.", "list", "100,10000"},
+        {"page-size", "Decks per deck grid page.", "count", "100"},
+        {"iterations", "Most runs of one benchmark at one size.", "count", "1000"},
+        {"budget-ms", "Time after which a benchmark stops once it ran a few times.", "ms", "3000"},
+        {"python", "Python interpreter for the mock server.", "path", "python3"},
+        {"mock-server", "mock_server.py to send prompts to.", "path", BENCH_MOCK_SERVER},
+        {"no-prompt", "Skip the prompt round trip."},
+        {"output", "Append the results to this file instead of writing them to stdout.", "path"},
+    });
+    parser.process(app);
+
+    QFile out;
+    if (parser.isSet("output"))
+    {
+        out.setFileName(parser.value("output"));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        {
+            qDebug() << "Cannot open" << out.fileName() << ":" << out.errorString();
+            return 1;
+        }
+    }
+    else if (!out.open(stdout, QIODevice::WriteOnly))
+    {
+        return 1;
+    }
+
+    QTemporaryDir scratch;
+    const bool postgres = parser.value("backend") == "postgres";
+    DBManager db = postgres ? DBManager(parser.value("host"), parser.value("database"), parser.value("user"), parser.value("port").toInt(), 1)
+                            : DBManager::sqlite(scratch.filePath("bench.sqlite"), 1);
+    if (!db.connect() || !db.migrate())
+    {
+        qDebug() << "Cannot open the benchmark database";
+        return 1;
+    }
+    if (parser.isSet("reset"))
+    {
+        // Cards go with their decks, the tombstones this leaves behind are dropped as well
+        db.executeQuery("DELETE FROM decks");
+        db.executeQuery("DELETE FROM deleted_rows");
+    }
+    PooledQuery existing = db.executeQuery("SELECT count(*) FROM decks");
+    if (!existing.next() || existing.value(0).toInt() > 0)
+    {
+        qDebug() << "The benchmark database already holds decks, run with --reset if it is only used for benchmarks";
+        return 1;
+    }
+
+    Report report;
+    report.out = &out;
+    report.backend = postgres ? "postgres" : "sqlite";
+    report.started = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    Limits limits;
+    limits.maxIterations = qMax(minIterations, parser.value("iterations").toInt());
+    limits.budgetMs = parser.value("budget-ms").toLongLong();
+
+    SyntheticData data;
+    // Decks first, so the grid sees only the decks seeded for it
+    if (!benchmarkDeckGrid(db, data, report, limits, parseSizes(parser.value("decks")), qMax(1, parser.value("page-size").toInt()))
+        || !benchmarkCards(db, data, report, limits, parseSizes(parser.value("cards"))))
+    {
+        qDebug() << "Seeding the benchmark database failed";
+        return 1;
+    }
+    if (!parser.isSet("no-prompt"))
+    {
+        benchmarkPrompt(report, limits, parser.value("python"), parser.value("mock-server"));
+    }
+    db.close();
+    return 0;
+}
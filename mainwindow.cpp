@@ -5,13 +5,21 @@
 #include <QDir>
 #include <QProcess>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QEvent>
 
 // Qt Widgets
 #include <QPushButton>
 #include <QToolBar>
 #include <QScrollArea>
 #include <QInputDialog>
+#include <QFileDialog>
+#include <QProgressDialog>
 #include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QListView>
+#include <QScrollBar>
+#include <QSet>
 
 // Qt SQL
 #include <QSqlDatabase>
@@ -24,6 +32,8 @@
 #include <QNetworkReply>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QJsonArray>
+#include <QSharedPointer>
 
 // Qt Utilities
 #include <QPointer>
@@ -31,32 +41,283 @@
 #include <QRandomGenerator>
 #include <QDebug>
 #include <QTimer>
+#include <QSettings>
+#include <QStandardPaths>
+#include <algorithm>
 
+// Prompt used for custom exercises, part of the exercise cache key together with the model
+static const QString exercisePromptTemplate = "Please create a sentence using the word \"{front_side}\", but output it with this word replaces by \"_\" and output only this sentence";
+// Native Ollama mode answers this many numbered prompts with one model call, same as server.py
+static const QString batchPromptPrefix = "Answer each numbered task independently. Reply only with a JSON object whose keys are the task numbers and whose values are the answers.\n";
+static const int batchChunkSize = 20;
 
+static QString exercisePrompt(const QString &frontSide)
+{
+    QString prompt = exercisePromptTemplate;
+    return prompt.replace("{front_side}", frontSide);
+}
+
+// Body of an Ollama /api/chat request with a single user message
+static QJsonObject ollamaChatRequest(const QString &model, const QString &prompt, bool stream, bool jsonFormat = false)
+{
+    QJsonObject message;
+    message["role"] = "user";
+    message["content"] = prompt;
+    QJsonObject json;
+    json["model"] = model;
+    json["messages"] = QJsonArray{message};
+    json["stream"] = stream;
+    if (jsonFormat) {
+        json["format"] = "json";
+    }
+    return json;
+}
+
+// Text of a streamed line, "token" from server.py or "message.content" from Ollama
+static QString streamToken(const QJsonObject &line)
+{
+    if (line.contains("message")) {
+        return line.value("message").toObject().value("content").toString();
+    }
+    return line.value("token").toString();
+}
 
 
+
+// The shared Postgres database, also the sync target when the application works on the local file
+static DBManager serverDatabase()
+{
+    return DBManager("localhost", "flashcards_db", "flashcards_user", 5432);
+}
+
+// database/backend "sqlite" keeps the data in an SQLite file on this machine, so the
+// application starts and works without the server; anything else uses Postgres directly
+static DBManager openDatabase()
+{
+    QSettings settings("Language_app_qt", "Language_app_qt");
+    if (settings.value("database/backend", "postgres").toString() != "sqlite") {
+        return serverDatabase();
+    }
+    QString path = settings.value("database/sqlitePath").toString();
+    if (path.isEmpty()) {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(dir);
+        path = dir + "/flashcards.sqlite";
+    }
+    return DBManager::sqlite(path);
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
-    , colCount(0)
-    , rowCount(0)
-    , dbManager("localhost", "flashcards_db", "flashcards_user", 5432)
+    , dbManager(openDatabase())
 {
-
-    if (!isServerRunning())
+    startupClock.start();
+    profileStartup = QCoreApplication::arguments().contains("--profile-startup");
+
+    QSettings settings("Language_app_qt", "Language_app_qt");
+    llmModel = settings.value("llm/model", "llama3").toString();
+    // "ollama" talks to the Ollama HTTP API directly, "server" goes through server.py
+    nativeOllama = settings.value("llm/mode", "server").toString() == "ollama";
+
+    // Generation servers, e.g. several Ollama hosts each running server.py. In server mode
+    // without a configured list the application runs its own server.py on a free port.
+    const QStringList defaultBackends = nativeOllama ? QStringList() << "http://localhost:11434/" : QStringList();
+    QList<QUrl> backendUrls;
+    for (const QString &backend : settings.value("llm/backends", defaultBackends).toStringList()) {
+        backendUrls.append(QUrl(backend));
+    }
+    llmClient = new LLMClient(backendUrls, this);
+    llmClient->setMaxConcurrent(settings.value("llm/maxConcurrent", 2).toInt());
+    llmClient->setTimeout(settings.value("llm/timeoutMs", 60000).toInt());
+    llmClient->setHedging(settings.value("llm/hedging", false).toBool(), settings.value("llm/hedgeDelayMs", 3000).toInt());
+
+    // Database work runs on its own thread and connection, results come back as plain values
+    dbManager.setPoolSize(settings.value("database/poolSize", 5).toInt());
+    asyncDb = new AsyncDBManager(dbManager, this);
+    // Imports and exports get a worker of their own, the views' database work doesn't queue behind them
+    transferDb = new AsyncDBManager(dbManager, this);
+    // Cards due for review are read in pages of this size
+    reviewScheduler = new ReviewScheduler(asyncDb, this);
+    reviewScheduler->setPageSize(settings.value("reviews/pageSize", 500).toInt());
+    // Search results are shown in pages of this size, further pages load as the list is scrolled
+    cardSearch = new CardSearch(dbManager, this);
+    cardSearch->setPageSize(settings.value("search/pageSize", 50).toInt());
+    // Card notifications arrive one per row, the decks they name are dropped together shortly after the first
+    deckChangeTimer = new QTimer(this);
+    deckChangeTimer->setSingleShot(true);
+    deckChangeTimer->setInterval(settings.value("database/notificationDelayMs", 200).toInt());
+    connect(deckChangeTimer, &QTimer::timeout, this, &MainWindow::dropChangedDecks);
+
+    serverSupervisor = nullptr;
+    if (!nativeOllama && backendUrls.isEmpty())
     {
         runServer();
     }
 
-    initializeDeckTable();
+    exercisePrefetcher = new ExercisePrefetcher(asyncDb, [this](const QString &frontSide, const QString &backSide, std::function<void(const QString &)> onResponse) {
+        promptOllama(frontSide, backSide, LLMClient::Background, exercisePrefetcher, onResponse);
+    }, this);
+    // Number of exercises generated ahead of the user, tune with the hit/miss stats
+    exercisePrefetcher->setDepth(settings.value("exercises/prefetchDepth", 3).toInt());
+    exercisePrefetcher->setCacheKey(llmModel, exercisePromptTemplate);
+    exercisePrefetcher->setCacheLimit(settings.value("exercises/cachePerCard", 5).toInt());
+    exercisePrefetcher->setRegenerate(settings.value("exercises/regenerate", false).toBool());
+    exercisePrefetcher->setWithoutReplacement(settings.value("exercises/withoutReplacement", true).toBool());
+    exercisePrefetcher->setBatchGenerator([this](const QVector<Exercise> &cards, std::function<void(int, const QString &)> onResult, std::function<void()> onFinished) {
+        promptOllamaBatch(cards, onResult, onFinished);
+    }, settings.value("exercises/batchSize", 50).toInt());
+    connect(exercisePrefetcher, &ExercisePrefetcher::pregenerateProgress, this, [](int deckId, int done, int total) {
+        qDebug() << "Pre-generated exercises for deck" << deckId << ":" << done << "/" << total;
+    });
+    if (settings.value("exercises/streaming", true).toBool()) {
+        exercisePrefetcher->setStreamGenerator([this](const QString &frontSide, const QString &backSide, QObject *context, std::function<void(const QString &)> onPartial, std::function<void(const QString &)> onResponse) {
+            promptOllamaStream(frontSide, backSide, context, onPartial, onResponse);
+        });
+    }
+
     // Set the size of the main window
     resize(600,800);
 
+    deckModel = new DeckModel(this);
+    deckModel->setPageLoader(nullptr, settings.value("decks/pageSize", 100).toInt());
+    deckDelegate = new DeckDelegate(this);
     setupMainLayout();
 
     connect(QApplication::instance(), &QApplication::aboutToQuit, this, &MainWindow::shutDownServer);
 
-    // Call loadDecks to load and display decks from the database
-    loadDecks();
+    // The window paints right away with a placeholder, decks fill in once the database is ready.
+    // It has a row of its own between the search results and the decks.
+    deckStatusLabel = new QLabel("Loading decks...");
+    deckStatusLabel->setAlignment(Qt::AlignCenter);
+    gridLayout->addWidget(deckStatusLabel, 1, 0);
+    startDatabase();
+    markStartupPhase("window constructed");
+}
+
+bool MainWindow::event(QEvent *event)
+{
+    bool handled = QMainWindow::event(event);
+    // The first update request after show() is when the window actually gets painted
+    if (!firstPaintDone && event->type() == QEvent::UpdateRequest && isVisible()) {
+        firstPaintDone = true;
+        markStartupPhase("first paint");
+    }
+    return handled;
+}
+
+void MainWindow::markStartupPhase(const QString &phase, qint64 elapsedMs)
+{
+    if (elapsedMs < 0) {
+        elapsedMs = startupClock.elapsed();
+    }
+    if (profileStartup) {
+        qDebug().noquote() << QString("Startup: %1 at %2 ms").arg(phase).arg(elapsedMs);
+    }
+}
+
+// Outcome of the startup work done on the database thread
+struct StartupResult
+{
+    bool ok = false;
+    QVector<QPair<int, QString>> decks;
+    QVector<QPair<QString, qint64>> phases;
+};
+
+void MainWindow::startDatabase()
+{
+    // Connecting, migrating the schema and reading the first page of decks happen on the database thread,
+    // so a slow or unreachable Postgres doesn't freeze the window
+    const int cacheMaxRows = QSettings("Language_app_qt", "Language_app_qt").value("exercises/cacheMaxRows", 100000).toInt();
+    const QElapsedTimer clock = startupClock;
+
+    const int decksPerPage = deckModel->pageSize();
+
+    asyncDb->run([cacheMaxRows, decksPerPage, clock](DBManager &db) {
+        StartupResult result;
+        result.ok = db.connect();
+        result.phases.append(qMakePair(QString("database connected"), clock.elapsed()));
+        if (result.ok) {
+            result.ok = db.migrate();
+            // A failed trim only means the cache stays larger for now
+            if (result.ok && !db.trimExerciseCache(cacheMaxRows)) {
+                qDebug() << "Failed to trim the exercise cache.";
+            }
+            result.phases.append(qMakePair(QString("schema ready"), clock.elapsed()));
+        }
+        if (result.ok) {
+            result.decks = db.fetchDecksPage(0, decksPerPage);
+            result.phases.append(qMakePair(QString("decks loaded"), clock.elapsed()));
+        }
+        return result;
+    }, this, [this](const StartupResult &result) {
+        onDatabaseReady(result.ok, result.decks, result.phases);
+    });
+}
+
+void MainWindow::onDatabaseReady(bool ok, const QVector<QPair<int, QString>> &decks, const QVector<QPair<QString, qint64>> &phases)
+{
+    for (const auto &phase : phases) {
+        markStartupPhase(phase.first, phase.second);
+    }
+    if (!ok) {
+        if (deckStatusLabel) {
+            deckStatusLabel->setText("Could not connect to the database.");
+        }
+        return;
+    }
+    delete deckStatusLabel;
+    // The worker's connect already proved the server reachable, the GUI thread's own
+    // connection is opened by the pool on its first query instead of blocking here
+    databaseReady = true;
+    // Further pages are loaded as the deck grid or the deck selector is scrolled to the end
+    deckModel->setPageLoader([this](int afterId, int limit, std::function<void(const QVector<QPair<int, QString>> &)> onPage) {
+        asyncDb->fetchDecksPage(afterId, limit, deckModel, onPage);
+    }, deckModel->pageSize());
+    deckModel->setDecks(decks);
+    // The deck catalog stays in memory and is patched from the triggers' notifications
+    connect(asyncDb, &AsyncDBManager::notification, this, &MainWindow::onDatabaseNotification);
+    asyncDb->listen(QStringList() << "deck_changes" << "flashcard_changes");
+    markStartupPhase("decks shown");
+    cardSearch->warmUp();
+    searchField->setEnabled(true);
+
+    // The local file is the working copy, changes travel to and from the server in the background
+    QSettings settings("Language_app_qt", "Language_app_qt");
+    if (dbManager.isSqlite() && settings.value("sync/enabled", true).toBool()) {
+        syncEngine = new SyncEngine(dbManager, serverDatabase(), this);
+        syncEngine->setInterval(settings.value("sync/intervalMs", 30000).toInt());
+        syncEngine->setBatchSize(settings.value("sync/batchSize", 500).toInt());
+        connect(syncEngine, &SyncEngine::synced, this, &MainWindow::onSynced);
+        syncEngine->start();
+    }
+}
+
+void MainWindow::onSynced(int, int pulled)
+{
+    if (pulled == 0) {
+        return;
+    }
+    asyncDb->fetchDecksPage(0, deckModel->pageSize(), deckModel, [this](const QVector<QPair<int, QString>> &decks) {
+        deckModel->setDecks(decks);
+    });
+    dropAllCardStores();
+}
+
+void MainWindow::dropAllCardStores()
+{
+    QList<int> deckIds = cardStoreVersions.keys();
+    for (int deckId : cardStores.keys()) {
+        if (!cardStoreVersions.contains(deckId)) {
+            deckIds.append(deckId);
+        }
+    }
+    for (int deckId : deckIds) {
+        dropCardStore(deckId);
+    }
+    for (int deckId : similarityIndexes.keys()) {
+        staleSimilarityIndexes.insert(deckId);
+    }
+    reviewScheduler->invalidateDeck(reviewScheduler->deckId());
 }
 
 void MainWindow::setupMainLayout() {
@@ -86,19 +347,123 @@ void MainWindow::setupMainLayout() {
         // Create and add buttons to the toolbar
         QPushButton *addDeckButton = new QPushButton("Add Deck");
         QPushButton *removeDeckButton = new QPushButton("Remove Deck");
+        QPushButton *reviewAllButton = new QPushButton("Review All");
+        QPushButton *exportAllButton = new QPushButton("Export All");
         comboBox = new QComboBox(); // ComboBox for selecting decks
+        // Shares the paged deck model, scrolling its popup loads further pages
+        comboBox->setModel(deckModel);
+        comboBox->setMinimumContentsLength(16);
+        comboBox->setSizeAdjustPolicy(QComboBox::AdjustToMinimumContentsLengthWithIcon);
 
         toolBar->addWidget(addDeckButton);
         toolBar->addWidget(removeDeckButton);
+        toolBar->addWidget(reviewAllButton);
+        toolBar->addWidget(exportAllButton);
         toolBar->addWidget(comboBox);
+        // Searches the cards of every deck as the user types
+        searchField = new QLineEdit();
+        searchField->setPlaceholderText("Search cards");
+        searchField->setClearButtonEnabled(true);
+        searchField->setEnabled(databaseReady);
+        toolBar->addWidget(searchField);
+        connect(searchField, &QLineEdit::textChanged, this, &MainWindow::searchCards);
 
         connect(addDeckButton, &QPushButton::clicked, this, &MainWindow::addDeck);
         connect(removeDeckButton, &QPushButton::clicked, this, &MainWindow::removeDeck);
+        // Cards due in every deck, in the order they became due
+        connect(reviewAllButton, &QPushButton::clicked, this, [this]() { showFlashcards(-1); });
+        connect(exportAllButton, &QPushButton::clicked, this, [this]() { exportDecks(QVector<int>()); });
+    }
+
+    // Only the visible tiles are painted, the columns follow the window width
+    QListView *deckView = new QListView();
+    deckView->setModel(deckModel);
+    deckView->setItemDelegate(deckDelegate);
+    deckView->setViewMode(QListView::IconMode);
+    deckView->setMovement(QListView::Static);
+    deckView->setResizeMode(QListView::Adjust);
+    deckView->setUniformItemSizes(true);
+    deckView->setGridSize(DeckDelegate::tileSize() + QSize(10, 10));
+    deckView->setSelectionMode(QAbstractItemView::NoSelection);
+    deckView->setFrameShape(QFrame::NoFrame);
+    deckView->setMouseTracking(true);
+    deckView->viewport()->setAttribute(Qt::WA_Hover);
+    gridLayout->addWidget(deckView, 2, 0);
+    connect(deckView, &QListView::clicked, this, [this](const QModelIndex &index) {
+        showOptions(deckModel->deckId(index));
+    });
+
+    // Above the decks while something is typed into the search field, a click opens the card's deck
+    searchResults = new QListWidget();
+    searchResults->setMaximumHeight(300);
+    searchResults->hide();
+    gridLayout->addWidget(searchResults, 0, 0);
+    connect(searchResults, &QListWidget::itemClicked, this, [this](QListWidgetItem *item) {
+        const QVariant deckId = item->data(Qt::UserRole);
+        if (deckId.isValid()) {
+            showOptions(deckId.toInt());
+        }
+    });
+    connect(searchResults->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        if (value == searchResults->verticalScrollBar()->maximum()) {
+            cardSearch->fetchMore(searchResults, [this](const QVector<SearchHit> &hits, bool more, const QString &error) {
+                appendSearchHits(hits, more, error);
+            });
+        }
+    });
+    if (searchField && !searchField->text().trimmed().isEmpty()) {
+        searchCards(searchField->text());
+    }
+}
+
+void MainWindow::searchCards(const QString &text)
+{
+    if (!searchResults) {
+        // Typing in another view goes back to the main view, which runs the search
+        if (!text.trimmed().isEmpty()) {
+            showMainView();
+        }
+        return;
+    }
+    searchResults->clear();
+    if (text.trimmed().isEmpty()) {
+        cardSearch->cancel();
+        searchResults->hide();
+        return;
+    }
+    searchResults->show();
+    // Every keystroke replaces the previous search, its results never arrive
+    cardSearch->search(text, searchResults, [this](const QVector<SearchHit> &hits, bool more, const QString &error) {
+        appendSearchHits(hits, more, error);
+    });
+}
+
+void MainWindow::appendSearchHits(const QVector<SearchHit> &hits, bool, const QString &error)
+{
+    if (!error.isEmpty()) {
+        // Not "No cards found", the search never got an answer
+        QListWidgetItem *failed = new QListWidgetItem(error);
+        failed->setFlags(Qt::NoItemFlags);
+        searchResults->addItem(failed);
+        return;
+    }
+    if (hits.isEmpty() && searchResults->count() == 0) {
+        QListWidgetItem *none = new QListWidgetItem("No cards found");
+        none->setFlags(Qt::NoItemFlags);
+        searchResults->addItem(none);
+        return;
+    }
+    for (const SearchHit &hit : hits) {
+        QListWidgetItem *item = new QListWidgetItem(hit.frontSide + " - " + hit.backSide);
+        item->setData(Qt::UserRole, hit.deckId);
+        item->setToolTip(hit.backSide);
+        searchResults->addItem(item);
     }
 }
 
 
 void MainWindow::clearGridLayout() {
+    ++gridGeneration;
     while (QLayoutItem *item = gridLayout->takeAt(0)) {
         delete item->widget();
         delete item;
@@ -107,104 +472,134 @@ void MainWindow::clearGridLayout() {
 
 void MainWindow::showMainView() {
 
+    // Leaving the exercises drops the prefetch work still waiting on the server
+    exercisePrefetcher->stop();
+    llmClient->cancel(exercisePrefetcher);
+    llmClient->logStats();
+    dbManager.logStats();
     clearGridLayout();
+    // The deck model is kept up to date, so coming back needs no database queries
     setupMainLayout();
-    loadDecks();
 }
 
-void MainWindow::initializeDeckTable()
+void MainWindow::onDatabaseNotification(const QString &channel, const QString &payload)
 {
-    // Connect to the database
-    if (!dbManager.connect())
+    const QJsonObject change = QJsonDocument::fromJson(payload.toUtf8()).object();
+    const QString op = change.value("op").toString();
+    if (channel == "deck_changes")
     {
-        qDebug() << "Failed to connect to the database.";
-        return;
-    }
-    // Check if the decks table exists, and create it if it does not
-    QString createTableQuery = "CREATE TABLE IF NOT EXISTS decks ( id SERIAL PRIMARY KEY, name VARCHAR(255) NOT NULL )";
-    QSqlQuery query = dbManager.executeQuery(createTableQuery);
-    if (query.lastError().type() != QSqlError::NoError)
-    {
-        qDebug() << "Failed to create decks table:" << query.lastError().text();
+        const int deckId = change.value("id").toInt();
+        if (op == "DELETE")
+        {
+            removeDeckWidget(deckId);
+        }
+        else if (op == "INSERT")
+        {
+            deckModel->addDeck(deckId, change.value("name").toString());
+        }
+        else
+        {
+            deckModel->renameDeck(deckId, change.value("name").toString());
+        }
     }
-    else
+    else if (channel == "flashcard_changes")
     {
-        qDebug() << "Decks table is ready.";
+        if (op == "SYNC")
+        {
+            // A sync engine pushed cards of any number of decks
+            dropAllCardStores();
+            return;
+        }
+        const int deckId = change.value("deck_id").toInt();
+        const int cardId = change.value("id").toInt();
+        // The deck's cards are read again the next time they are needed, once per burst of changes
+        changedDecks.insert(deckId);
+        if (!deckChangeTimer->isActive())
+        {
+            deckChangeTimer->start();
+        }
+        QSharedPointer<SimilarityIndex> index = similarityIndexes.value(deckId);
+        if (op == "INSERT" || op == "UPDATE")
+        {
+            if (op == "INSERT")
+            {
+                reviewScheduler->addCard(cardId, deckId);
+            }
+            if (index)
+            {
+                changedCards[deckId].insert(cardId);
+            }
+        }
+        else if (op == "DELETE")
+        {
+            reviewScheduler->remove(cardId);
+            if (index)
+            {
+                index->remove(cardId);
+            }
+        }
+        else if (op == "IMPORT")
+        {
+            reviewScheduler->invalidateDeck(deckId);
+            if (index)
+            {
+                staleSimilarityIndexes.insert(deckId);
+            }
+        }
     }
 }
-void MainWindow::initializeFlashcardsTable()
+
+void MainWindow::dropChangedDecks()
 {
-    // Connect to the database
-    if (!dbManager.connect())
-    {
-        qDebug() << "Failed to connect to the database.";
-        return;
-    }
-    // Check if the decks table exists, and create it if it does not
-    QString createTableQuery = "CREATE TABLE IF NOT EXISTS flashcards ( id SERIAL PRIMARY KEY, frontSide TEXT NOT NULL, backSide TEXT NOT NULL, deck_id INTEGER NOT NULL, FOREIGN KEY (deck_id) REFERENCES decks(id) ON DELETE CASCADE )";
-    QSqlQuery query = dbManager.executeQuery(createTableQuery);
-    if (query.lastError().type() != QSqlError::NoError)
+    const QSet<int> deckIds = changedDecks;
+    changedDecks.clear();
+    for (int deckId : deckIds)
     {
-        qDebug() << "Failed to create flashcards table:" << query.lastError().text();
+        dropCardStore(deckId);
     }
-    else
+    // The similarity indexes take the changed cards one by one instead of re-reading their decks
+    for (auto it = changedCards.constBegin(); it != changedCards.constEnd(); ++it)
     {
-        qDebug() << "Flashcards table is ready.";
+        const int deckId = it.key();
+        const QVector<int> cardIds(it.value().constBegin(), it.value().constEnd());
+        asyncDb->run([deckId, cardIds](DBManager &db) {
+            return db.fetchFlashcardsById(deckId, cardIds);
+        }, this, [this, deckId, cardIds](const QVector<FlashcardRecord> &cards) {
+            QSharedPointer<SimilarityIndex> index = similarityIndexes.value(deckId);
+            if (!index)
+            {
+                return;
+            }
+            QSet<int> found;
+            for (const FlashcardRecord &card : cards)
+            {
+                index->add(card.id, card.frontSide);
+                found.insert(card.id);
+            }
+            // Cards moved to another deck or deleted since the notification
+            for (int cardId : cardIds)
+            {
+                if (!found.contains(cardId))
+                {
+                    index->remove(cardId);
+                }
+            }
+        });
     }
+    changedCards.clear();
 }
 
-void MainWindow::loadDecks()
+void MainWindow::addDeckWidget(int deckId, const QString &deckName)
 {
-    // ensures that we start from the begining
-    colCount = 0;
-    rowCount = 0;
-    // Retrieve the decks from the database
-    QString selectQuery = "SELECT name, id FROM decks";
-    QSqlQuery query = dbManager.executeQuery(selectQuery);
-    while (query.next())
-    {
-        int deckId = query.value("id").toInt();
-        QString deckName = query.value("name").toString();
-        // Add the deck to the UI
-        ClickableLabel *newDeck = new ClickableLabel();
-        newDeck->setText(deckName);
-        newDeck->setAlignment(Qt::AlignCenter);
-        newDeck->setFrameStyle(QFrame::Panel | QFrame::Raised);
-        //styling using css like syntax
-        newDeck->setStyleSheet("ClickableLabel {"
-                               "background-color: #2e2e2e;"
-                               "color: #f0f0f0;"
-                               "border: 2px solid #8f8f91;"
-                               "border-radius: 10px;"
-                               "padding: 10px;"
-                               "font: bold 14px;"
-                               "}"
-                               "ClickableLabel:hover {"
-                               "background-color: #1e1e1e;"
-                               "color: #c0c0c0;"
-                               "}");
-        // Set fixed size for the deck
-        newDeck->setFixedSize(180, 120);
-        // Example grid positioning logic
-        gridLayout->addWidget(newDeck, rowCount, colCount);
-        colCount++;
-        if (colCount >= 3)
-        {
-            colCount = 0;
-            rowCount++;
-        }
-        // Store the widget in the map using the newDeckId
-        deckWidgets[deckId] = newDeck;
-        // Add deck name to combo box
-        comboBox->addItem(deckName, deckId);
-
-        // Connect the ClickableLabel's clicked signal to showOptions slot
-        connect(newDeck, &ClickableLabel::clicked, this, &MainWindow::showOptions);
-    }
+    deckModel->addDeck(deckId, deckName);
 }
 
 void MainWindow::addDeck()
 {
+    if (!databaseReady)
+    {
+        return;
+    }
     // Prompt the user for the deck name
     bool ok;
     QString deckName = QInputDialog::getText(this, tr("Add Deck"), tr("Deck Name:"), QLineEdit::Normal, QString(), &ok);
@@ -212,120 +607,48 @@ void MainWindow::addDeck()
     if (ok && !deckName.isEmpty())
     {
 
-        // Prepare the query and values
-        QString insertQuery = "INSERT INTO decks (name) VALUES (?)";
-        QVariantList values;
-        values << deckName;
-        // Execute the query securely
-        QSqlQuery result = dbManager.executeQuery(insertQuery, values);
-
-        // Check if the insertion was successful
-        if (result.lastError().type() != QSqlError::NoError)
-        {
-            qDebug() << "Failed to insert deck into the database:" << result.lastError().text();
-            return;
-        }
-
-        // Get the ID of the last inserted deck
-        int newDeckId = result.lastInsertId().toInt();
-
-        ClickableLabel *newDeck = new ClickableLabel();
-        newDeck->setText(deckName);
-        newDeck->setAlignment(Qt::AlignCenter);
-        newDeck->setFrameStyle(QFrame::Panel | QFrame::Raised);
-        newDeck->setStyleSheet("ClickableLabel {"
-                               "background-color: #2e2e2e;"
-                               "color: #f0f0f0;"
-                               "border: 2px solid #8f8f91;"
-                               "border-radius: 10px;"
-                               "padding: 10px;"
-                               "font: bold 14px;"
-                               "}"
-                               "ClickableLabel:hover {"
-                               "background-color: #1e1e1e;"
-                               "color: #c0c0c0;"
-                               "}");
-        // Set fixed size for the deck
-        newDeck->setFixedSize(180, 120);
-        // Example grid positioning logic
-        gridLayout->addWidget(newDeck, rowCount, colCount);
-        colCount++;
-        if (colCount >= 3)
-        {
-            colCount = 0;
-            rowCount++;
-        }
-
-        // Store the widget in the map using the newDeckId
-        deckWidgets[newDeckId] = newDeck;
-
-        // Add deck name to combo box
-        comboBox->addItem(deckName, newDeckId);
-        connect(newDeck, &ClickableLabel::clicked, this, &MainWindow::showOptions);
+        // The deck is shown once the insert on the database thread returns its id
+        asyncDb->addDeck(deckName, this, [this, deckName](int newDeckId) {
+            if (newDeckId >= 0)
+            {
+                addDeckWidget(newDeckId, deckName);
+            }
+        });
     }
 }
 
 void MainWindow::removeDeck()
 {
+    if (!databaseReady)
+    {
+        return;
+    }
     int index = comboBox->currentIndex();
     if (index != -1)
     {
-        QVariant data = comboBox->itemData(index);
-        int deckId = data.toInt();
-
-        QString query = "DELETE FROM decks WHERE id = ?";
-        QVariantList values;
-        values << deckId;
+        int deckId = comboBox->itemData(index, DeckModel::DeckIdRole).toInt();
 
-        QSqlQuery result = dbManager.executeQuery(query, values);
-
-        if (result.lastError().type() != QSqlError::NoError)
-        {
-            qDebug() << "Failed to delete deck from the database" << result.lastError().text();
-            return;
-        }
-        // Remove the widget from the map and the layout
-        if (deckWidgets.contains(deckId))
-        {
-            QWidget *itemWidget = deckWidgets.value(deckId);
-            if (itemWidget)
+        asyncDb->removeDeck(deckId, this, [this, deckId](bool ok) {
+            if (ok)
             {
-                qDebug() << "Removing widget with deckId:" << deckId;
-                gridLayout->removeWidget(itemWidget);
-                delete itemWidget; deckWidgets.remove(deckId);
+                removeDeckWidget(deckId);
             }
-            else
-            {
-                qDebug() << "Item widget for deckId" << deckId << "is null.";
-            }
-        }
-        else
-        {
-            qDebug() << "DeckWidgets does not contain deckId:" << deckId;
-        }
-        comboBox->removeItem(index);
+        });
     }
 
 }
 
-void MainWindow::showOptions() {
-    // Find which ClickableLabel triggered this slot
-    ClickableLabel *clickedLabel = qobject_cast<ClickableLabel*>(sender());
-    if (!clickedLabel) {
-        return; // Safety check, in case the sender is not a ClickableLabel
-    }
-
-    // Find the corresponding deckId
-    int deckId = -1;
-    for (auto it = deckWidgets.begin(); it != deckWidgets.end(); ++it) {
-        if (it.value() == clickedLabel) {
-            deckId = it.key();
-            break;
-        }
-    }
+void MainWindow::removeDeckWidget(int deckId)
+{
+    // The combo box shares the model and drops the deck with it
+    deckModel->removeDeck(deckId);
+    similarityIndexes.remove(deckId);
+    staleSimilarityIndexes.remove(deckId);
+}
 
+void MainWindow::showOptions(int deckId) {
     if (deckId == -1) {
-        return; // Safety check, in case the deckId wasn't found
+        return; // Safety check, in case the click was not on a deck
     }
 
     // Create a dialog to show options
@@ -337,19 +660,36 @@ void MainWindow::showOptions() {
 
     // Add buttons to the layout
     QPushButton *addFlashcardButton = new QPushButton("Add Flashcard", &optionsDialog);
+    QPushButton *importFlashcardsButton = new QPushButton("Import Flashcards", &optionsDialog);
+    QPushButton *exportDeckButton = new QPushButton("Export Deck", &optionsDialog);
     QPushButton *openFlashcardsButton = new QPushButton("Open Flashcards", &optionsDialog);
     QPushButton *openCustomExercisesButton = new QPushButton("Custom Exercises", &optionsDialog);
+    QPushButton *multipleChoiceButton = new QPushButton("Multiple Choice", &optionsDialog);
+    QPushButton *pregenerateButton = new QPushButton("Pre-generate Exercises", &optionsDialog);
     QPushButton *cancelButton = new QPushButton("Cancel", &optionsDialog);
 
     layout->addWidget(addFlashcardButton);
+    layout->addWidget(importFlashcardsButton);
+    layout->addWidget(exportDeckButton);
     layout->addWidget(openFlashcardsButton);
     layout->addWidget(openCustomExercisesButton);
+    layout->addWidget(multipleChoiceButton);
+    layout->addWidget(pregenerateButton);
     layout->addWidget(cancelButton);
 
     // Connect buttons to their respective slots
     connect(addFlashcardButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){addFlashcard(deckId); optionsDialog.accept();});
+    connect(importFlashcardsButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){optionsDialog.accept(); importFlashcards(deckId);});
+    connect(exportDeckButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){optionsDialog.accept(); exportDecks(QVector<int>() << deckId);});
     connect(openFlashcardsButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){showFlashcards(deckId); optionsDialog.accept();});
     connect(openCustomExercisesButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){showCustomExercise(deckId); optionsDialog.accept();});
+    connect(multipleChoiceButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){showMultipleChoice(deckId); optionsDialog.accept();});
+    connect(pregenerateButton, &QPushButton::clicked, &optionsDialog, [deckId, this, &optionsDialog](){
+        exercisePrefetcher->pregenerate(deckId, this, [deckId](int missing) {
+            qDebug() << "Pre-generating exercises for" << missing << "cards of deck" << deckId;
+        });
+        optionsDialog.accept();
+    });
     connect(cancelButton, &QPushButton::clicked, &optionsDialog, &QDialog::reject);
 
     // Execute the dialog
@@ -358,7 +698,6 @@ void MainWindow::showOptions() {
 
 void MainWindow::addFlashcard(int deckId)
 {
-    initializeFlashcardsTable();
     // Prompt the user for the flashcard info
     bool ok;
     QString frontSide = QInputDialog::getText(this, tr("Add Flashcard"), tr("Front (Question):"), QLineEdit::Normal, QString(), &ok);
@@ -367,36 +706,95 @@ void MainWindow::addFlashcard(int deckId)
     QString backSide = QInputDialog::getText(this, tr("Add Flashcard"), tr("Back (Answer):"), QLineEdit::Normal, QString(), &ok);
     if (!ok || backSide.isEmpty())
         return;
-    if (dbManager.addFlashcard(deckId, frontSide, backSide))
-    {
-        qDebug() << "Flashcard was added successfully";
-    } else {
-        qDebug() << "Failed to add flashcard";
-    }
+    asyncDb->addFlashcard(deckId, frontSide, backSide, this, [this, deckId, frontSide](int cardId) {
+        if (cardId >= 0)
+        {
+            qDebug() << "Flashcard was added successfully";
+            dropCardStore(deckId);
+            if (QSharedPointer<SimilarityIndex> index = similarityIndexes.value(deckId)) {
+                index->add(cardId, frontSide);
+            }
+        } else {
+            qDebug() << "Failed to add flashcard";
+        }
+    });
 }
 
 
-void MainWindow::showFlashcards(int deckId)
+void MainWindow::importFlashcards(int deckId)
 {
-    // Clear the grid layout
-    QLayoutItem *item;
-    while ((item = gridLayout->takeAt(0)) != nullptr) {
-        delete item->widget();
-        delete item;
-    }
-    QSqlQuery query = dbManager.fetchFlashcards(deckId);
+    const QString path = QFileDialog::getOpenFileName(this, tr("Import Flashcards"), QString(), tr("Flashcards (*.csv *.tsv *.txt *.jsonl);;All files (*)"));
+    if (path.isEmpty())
+        return;
 
-    QVector<QPair<QString, QString>> flashcards;
-    while (query.next()) {
-        QString question = query.value("frontSide").toString();
-        QString answer = query.value("backSide").toString();
-        flashcards.append(qMakePair(question, answer));
-    }
+    // The import runs on the database thread, the dialog only follows its progress
+    QProgressDialog *progress = new QProgressDialog(tr("Importing flashcards..."), tr("Cancel"), 0, 1000, this);
+    progress->setWindowModality(Qt::NonModal);
+    progress->setMinimumDuration(0);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    QSharedPointer<QAtomicInt> cancelled = QSharedPointer<QAtomicInt>::create(0);
+    connect(progress, &QProgressDialog::canceled, this, [cancelled]() { cancelled->storeRelaxed(1); });
+
+    const int batchSize = QSettings("Language_app_qt", "Language_app_qt").value("import/batchSize", 500).toInt();
+    transferDb->importCards(deckId, path, batchSize, cancelled, progress, [progress](qint64 done, qint64 total) {
+        progress->setValue(total > 0 ? int(done * 1000 / total) : 0);
+    }, [this, deckId, progress](const ImportResult &result) {
+        progress->close();
+        if (!result.ok) {
+            qDebug() << "Import failed:" << result.error;
+            QMessageBox::warning(this, tr("Import Flashcards"), result.error);
+            return;
+        }
+        qDebug() << "Imported" << result.imported << "flashcards," << result.duplicates << "duplicates," << result.invalid << "invalid rows";
+        dropCardStore(deckId);
+        reviewScheduler->invalidateDeck(deckId);
+        if (similarityIndexes.contains(deckId)) {
+            staleSimilarityIndexes.insert(deckId);
+        }
+        // Further decks of a multi-deck export, this client hears no notification of its own
+        for (const QPair<int, QString> &deck : result.createdDecks) {
+            deckModel->addDeck(deck.first, deck.second);
+            reviewScheduler->invalidateDeck(deck.first);
+        }
+        QMessageBox::information(this, tr("Import Flashcards"),
+                                 tr("Imported %1 flashcards.\nSkipped %2 duplicates and %3 incomplete rows.").arg(result.imported).arg(result.duplicates).arg(result.invalid));
+    });
+}
 
-    if (flashcards.isEmpty()) {
-        qDebug() << "No flashcards found for deck ID:" << deckId;
+void MainWindow::exportDecks(const QVector<int> &deckIds)
+{
+    const QString path = QFileDialog::getSaveFileName(this, tr("Export Flashcards"), QString(), tr("JSON lines with exercises (*.jsonl);;CSV (*.csv)"));
+    if (path.isEmpty())
         return;
-    }
+
+    // Same as the import, the cards are streamed to the file on the database thread
+    QProgressDialog *progress = new QProgressDialog(tr("Exporting flashcards..."), tr("Cancel"), 0, 1000, this);
+    progress->setWindowModality(Qt::NonModal);
+    progress->setMinimumDuration(0);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    QSharedPointer<QAtomicInt> cancelled = QSharedPointer<QAtomicInt>::create(0);
+    connect(progress, &QProgressDialog::canceled, this, [cancelled]() { cancelled->storeRelaxed(1); });
+
+    const int fetchSize = QSettings("Language_app_qt", "Language_app_qt").value("export/fetchSize", 1000).toInt();
+    transferDb->exportDecks(deckIds, path, fetchSize, cancelled, progress, [progress](qint64 done, qint64 total) {
+        progress->setValue(total > 0 ? int(done * 1000 / total) : 0);
+    }, [this, progress](const ExportResult &result) {
+        progress->close();
+        if (!result.ok) {
+            qDebug() << "Export failed:" << result.error;
+            QMessageBox::warning(this, tr("Export Flashcards"), result.error);
+            return;
+        }
+        qDebug() << "Exported" << result.exported << "flashcards";
+        QMessageBox::information(this, tr("Export Flashcards"), tr("Exported %1 flashcards.").arg(result.exported));
+    });
+}
+
+void MainWindow::showFlashcards(int deckId)
+{
+    // Clear the grid layout
+    clearGridLayout();
+    const int generation = gridGeneration;
 
     // Create a widget to display the flashcards
     QWidget *flashcardWidget = new QWidget;
@@ -437,136 +835,338 @@ void MainWindow::showFlashcards(int deckId)
     // Center the text in the labels
     questionLabel->setAlignment(Qt::AlignCenter);
     answerLabel->setAlignment(Qt::AlignCenter);
+    questionLabel->setText("Loading cards...");
 
     layout->addWidget(questionLabel);
     layout->addWidget(answerLabel);
 
-    // Create a button to show the next flashcard
-    QPushButton *nextButton = new QPushButton("Next Flashcard", flashcardWidget);
-    layout->addWidget(nextButton);
+    // Add a button to show the answer
+    QPushButton *showAnswerButton = new QPushButton("Show Answer", flashcardWidget);
+    layout->addWidget(showAnswerButton);
+
+    // Grading the answer schedules the card and shows the next one due
+    QHBoxLayout *gradeLayout = new QHBoxLayout;
+    const QVector<QPair<QString, ReviewScheduler::Grade>> grades = {
+        qMakePair(QString("Again"), ReviewScheduler::Again),
+        qMakePair(QString("Hard"), ReviewScheduler::Hard),
+        qMakePair(QString("Good"), ReviewScheduler::Good),
+        qMakePair(QString("Easy"), ReviewScheduler::Easy),
+    };
+    QVector<QPushButton *> gradeButtons;
+    for (const auto &grade : grades) {
+        QPushButton *gradeButton = new QPushButton(grade.first, flashcardWidget);
+        gradeButton->setEnabled(false);
+        gradeLayout->addWidget(gradeButton);
+        gradeButtons.append(gradeButton);
+    }
+    layout->addLayout(gradeLayout);
 
     // Add the flashcard widget to the grid layout
     gridLayout->addWidget(flashcardWidget);
 
-    // Function to show a random flashcard
-    auto showRandomFlashcard = [flashcards, questionLabel, answerLabel, this]() {
-        if (flashcards.isEmpty())
-        {
-            showOptions();
-            qDebug() << "No flashcards available to show.";
-            return;
-        }
-        int randomIndex = QRandomGenerator::global()->bounded(flashcards.size());
-        if (randomIndex < 0 || randomIndex >= flashcards.size())
-        {
-            showOptions();
-            qDebug() << "Generated index out of range:" << randomIndex;
-            return;
+    // The card shown, read by id with its answer, and the last card that could not be read
+    struct Shown
+    {
+        int cardId = -1;
+        QString backSide;
+        int missedCardId = -1;
+    };
+    QSharedPointer<Shown> shown = QSharedPointer<Shown>::create();
+    auto setGradingEnabled = [gradeButtons](bool enabled) {
+        for (QPushButton *gradeButton : gradeButtons) {
+            gradeButton->setEnabled(enabled);
         }
-        const auto &flashcard = flashcards[randomIndex];
-        questionLabel->setText(flashcard.first);
-        answerLabel->setText(flashcard.second);
-        answerLabel->setVisible(false); // Hide the answer initially
-
-        qDebug() << "Showing flashcard at index:" << randomIndex;
     };
-    // Show the first random flashcard
-    showRandomFlashcard();
 
-    // Connect the next button to show the next random flashcard
-    connect(nextButton, &QPushButton::clicked, showRandomFlashcard);
+    // Function to show the card due first, -1 reviews every deck
+    auto showNextFlashcard = QSharedPointer<std::function<void()>>::create();
+    *showNextFlashcard = [this, shown, questionLabel, answerLabel, showAnswerButton, setGradingEnabled, flashcardWidget, showNextFlashcardRef = showNextFlashcard.toWeakRef()]() {
+        answerLabel->clear();
+        answerLabel->setVisible(false); // Hide the answer initially
+        setGradingEnabled(false);
+        showAnswerButton->setEnabled(false);
+        reviewScheduler->nextCard(flashcardWidget, [=](const ReviewState &state) {
+            if (state.cardId == -1) {
+                shown->cardId = -1;
+                questionLabel->setText(state.due.isValid() ? "No cards due until " + state.due.toLocalTime().toString("yyyy-MM-dd hh:mm") : "No flashcards in this deck.");
+                qDebug() << "No flashcards due for review.";
+                return;
+            }
+            asyncDb->run([deckId = state.deckId, cardId = state.cardId](DBManager &db) {
+                return db.fetchFlashcardsById(deckId, QVector<int>() << cardId);
+            }, flashcardWidget, [=](const QVector<FlashcardRecord> &found) {
+                if (generation != gridGeneration) {
+                    return;
+                }
+                if (found.isEmpty()) {
+                    if (shown->missedCardId == state.cardId) {
+                        // Still missing after reading the queue again, the card is gone
+                        reviewScheduler->remove(state.cardId);
+                    } else {
+                        // Deleted or moved since the queue was read, read it again rather than dropping the card
+                        shown->missedCardId = state.cardId;
+                        reviewScheduler->invalidateDeck(state.deckId);
+                    }
+                    if (auto next = showNextFlashcardRef.toStrongRef()) {
+                        (*next)();
+                    }
+                    return;
+                }
+                shown->cardId = state.cardId;
+                shown->backSide = found.first().backSide;
+                shown->missedCardId = -1;
+                questionLabel->setText(found.first().frontSide);
+                showAnswerButton->setEnabled(true);
+                qDebug() << "Showing flashcard" << state.cardId << "due" << state.due;
+            });
+        });
+    };
+    // Show the first card due
+    reviewScheduler->start(deckId);
+    (*showNextFlashcard)();
+
+    for (int i = 0; i < gradeButtons.size(); ++i) {
+        const ReviewScheduler::Grade grade = grades.at(i).second;
+        connect(gradeButtons.at(i), &QPushButton::clicked, flashcardWidget, [this, shown, grade, showNextFlashcard]() {
+            if (shown->cardId == -1) {
+                return;
+            }
+            reviewScheduler->grade(shown->cardId, grade);
+            (*showNextFlashcard)();
+        });
+    }
 
-    // Add a button to show the answer
-    QPushButton *showAnswerButton = new QPushButton("Show Answer", flashcardWidget);
-    layout->addWidget(showAnswerButton);
-    connect(showAnswerButton, &QPushButton::clicked, this, [=]() { answerLabel->setVisible(true); });
+    connect(showAnswerButton, &QPushButton::clicked, flashcardWidget, [=]() {
+        if (shown->cardId == -1) {
+            return;
+        }
+        answerLabel->setText(shown->backSide);
+        answerLabel->setVisible(true);
+        setGradingEnabled(true);
+    });
 }
 
-void MainWindow::promptOllama(const QString &frontSide, const QString &backSide, QLabel *sentenceLabel, std::function<void()>onResponse)
+void MainWindow::fetchCardStore(int deckId, std::function<void(QSharedPointer<CardStore>)> onReady)
 {
-    QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-    QUrl url("http://localhost:8000/prompt/");
-    QNetworkRequest request(url);
+    if (QSharedPointer<CardStore> cards = cardStores.value(deckId)) {
+        onReady(cards);
+        return;
+    }
+    const int version = cardStoreVersions.value(deckId);
+    asyncDb->fetchCardStore(deckId, this, [this, deckId, version, onReady](QSharedPointer<CardStore> cards) {
+        if (cards && version == cardStoreVersions.value(deckId)) {
+            cardStores.insert(deckId, cards);
+        }
+        onReady(cards);
+    });
+}
 
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+void MainWindow::dropCardStore(int deckId)
+{
+    // Views still showing the old cards keep their copy until they are closed
+    cardStores.remove(deckId);
+    cardStoreVersions[deckId]++;
+    exercisePrefetcher->invalidateDeck(deckId);
+}
 
+void MainWindow::promptOllama(const QString &frontSide, const QString &backSide, LLMClient::Priority priority, QObject *context, std::function<void(const QString &response)> onResponse)
+{
+    QString path = "/prompt/";
     QJsonObject json;
-    json["front_side"] = frontSide;
-    json["back_side"] = backSide;
-    QJsonDocument doc(json);
-    QByteArray data = doc.toJson();
-
-    QNetworkReply *reply = manager->post(request, data);
+    if (nativeOllama) {
+        path = "/api/chat";
+        json = ollamaChatRequest(llmModel, exercisePrompt(frontSide), false);
+    } else {
+        json["front_side"] = frontSide;
+        json["back_side"] = backSide;
+        json["model"] = llmModel;
+        json["prompt_template"] = exercisePromptTemplate;
+    }
 
-    connect(reply, &QNetworkReply::finished, this, [this, reply, sentenceLabel, onResponse]() {
-        if (reply->error() == QNetworkReply::NoError) {
-            QByteArray response_data = reply->readAll();
+    // Identical prompts for the same card share one request while it is in flight
+    llmClient->post(path, json, priority, context, [this, onResponse](const QByteArray &response_data) {
+        QString response_text;
+        if (!response_data.isEmpty()) {
             QJsonDocument response_doc = QJsonDocument::fromJson(response_data);
             QJsonObject response_obj = response_doc.object();
-            QString response_text = response_obj["response"].toString();
+            if (nativeOllama) {
+                response_text = response_obj.value("message").toObject().value("content").toString().trimmed();
+            } else {
+                response_text = response_obj["response"].toString();
+            }
             ollamaResponse = response_text;
             qDebug() << "Ollama's response:" << response_text;
-            sentenceLabel->setText(response_text);  // Update the text with the server response
-        } else {
-            qDebug() << "Error:" << reply->errorString();
         }
-        reply->deleteLater();
-        onResponse();
-    });
+        onResponse(response_text);
+    }, nullptr, frontSide + '\n' + backSide);
 }
 
-
-void MainWindow::showCustomExercise(int deckId)
+void MainWindow::promptOllamaStream(const QString &frontSide, const QString &backSide, QObject *context, std::function<void(const QString &partial)> onPartial, std::function<void(const QString &response)> onResponse)
 {
-    QSqlQuery query = dbManager.fetchFlashcards(deckId);
-    QVector<QPair<QString, QString>> flashcards;
-    while (query.next()) {
-        QString question = query.value("frontSide").toString();
-        QString answer = query.value("backSide").toString();
-        flashcards.append(qMakePair(question, answer));
+    QString path = "/prompt/stream";
+    QJsonObject json;
+    if (nativeOllama) {
+        path = "/api/chat";
+        json = ollamaChatRequest(llmModel, exercisePrompt(frontSide), true);
+    } else {
+        json["front_side"] = frontSide;
+        json["back_side"] = backSide;
+        json["model"] = llmModel;
+        json["prompt_template"] = exercisePromptTemplate;
     }
-    if (flashcards.isEmpty()) {
-        qDebug() << "No flashcards found for deck ID:" << deckId;
+
+    // Both servers send one JSON object per line, tokens are shown as soon as a line is complete
+    QSharedPointer<QString> text = QSharedPointer<QString>::create();
+    llmClient->post(path, json, LLMClient::Interactive, context, [this, onResponse](const QByteArray &response_data) {
+        // Rebuilt from the whole body, a caller that joined a running stream missed its first tokens.
+        // A stream that broke off before its done line is no sentence, whatever it got to.
+        QString response_text;
+        bool done = false;
+        for (const QByteArray &line : response_data.split('\n')) {
+            const QJsonObject object = QJsonDocument::fromJson(line).object();
+            response_text += streamToken(object);
+            done = done || object.value("done").toBool();
+        }
+        response_text = done ? response_text.trimmed() : QString();
+        if (!response_text.isEmpty()) {
+            ollamaResponse = response_text;
+            qDebug() << "Ollama's response:" << response_text;
+        }
+        onResponse(response_text);
+    }, [text, onPartial](const QJsonObject &line) {
+        QString token = streamToken(line);
+        if (!token.isEmpty()) {
+            text->append(token);
+            onPartial(*text);
+        }
+    }, "stream\n" + frontSide + '\n' + backSide);
+}
+
+void MainWindow::promptOllamaBatch(const QVector<Exercise> &cards, std::function<void(int cardId, const QString &response)> onResult, std::function<void()> onFinished)
+{
+    if (nativeOllama) {
+        promptOllamaBatchNative(cards, onResult, onFinished);
         return;
     }
-    int randomIndex = QRandomGenerator::global()->bounded(flashcards.size());
-    const auto &flashcard = flashcards[randomIndex];
-    QString frontSide = flashcard.first;
-    QString backSide = flashcard.second;
 
-    QLabel *sentenceLabel = new QLabel("Generating custom task", this);
-    QLineEdit *inputEdit = new QLineEdit(this);
-    QPushButton *submitButton = new QPushButton("Submit", this);
-    QPushButton *nextButton = new QPushButton("Next Exercise", this);
+    QJsonArray jsonCards;
+    for (const Exercise &card : cards) {
+        QJsonObject jsonCard;
+        jsonCard["id"] = card.cardId;
+        jsonCard["front_side"] = card.frontSide;
+        jsonCard["back_side"] = card.backSide;
+        jsonCards.append(jsonCard);
+    }
+    QJsonObject json;
+    json["cards"] = jsonCards;
+    json["model"] = llmModel;
+    json["prompt_template"] = exercisePromptTemplate;
+
+    // Results arrive as one line per card while the server works through the batch
+    llmClient->post("/prompt/batch", json, LLMClient::Background, this, [onFinished](const QByteArray &) {
+        onFinished();
+    }, [onResult](const QJsonObject &line) {
+        if (line.contains("id")) {
+            onResult(line["id"].toInt(), line["response"].toString().trimmed());
+        }
+    });
+}
+
+void MainWindow::promptOllamaBatchNative(const QVector<Exercise> &cards, std::function<void(int cardId, const QString &response)> onResult, std::function<void()> onFinished)
+{
+    // Same approach as server.py: numbered prompts answered as one JSON object per model call,
+    // anything the model skipped is generated on its own
+    QSharedPointer<int> remaining = QSharedPointer<int>::create(1);
+    auto done = [remaining, onFinished]() {
+        if (--*remaining == 0) {
+            onFinished();
+        }
+    };
+
+    for (int start = 0; start < cards.size(); start += batchChunkSize) {
+        const QVector<Exercise> chunk = cards.mid(start, batchChunkSize);
+        QString numbered;
+        for (int i = 0; i < chunk.size(); ++i) {
+            numbered += QString::number(i + 1) + ". " + exercisePrompt(chunk[i].frontSide) + '\n';
+        }
+
+        ++*remaining;
+        llmClient->post("/api/chat", ollamaChatRequest(llmModel, batchPromptPrefix + numbered, false, true), LLMClient::Background, this,
+                        [this, chunk, onResult, done, remaining](const QByteArray &response_data) {
+            if (!response_data.isEmpty()) {
+                const QString content = QJsonDocument::fromJson(response_data).object().value("message").toObject().value("content").toString();
+                const QJsonObject answers = QJsonDocument::fromJson(content.toUtf8()).object();
+                for (int i = 0; i < chunk.size(); ++i) {
+                    const Exercise card = chunk[i];
+                    const QString sentence = answers.value(QString::number(i + 1)).toString().trimmed();
+                    if (!sentence.isEmpty()) {
+                        onResult(card.cardId, sentence);
+                        continue;
+                    }
+                    ++*remaining;
+                    promptOllama(card.frontSide, card.backSide, LLMClient::Background, this, [card, onResult, done](const QString &single) {
+                        if (!single.isEmpty()) {
+                            onResult(card.cardId, single);
+                        }
+                        done();
+                    });
+                }
+            }
+            done();
+        });
+    }
+    done();
+}
+
+void MainWindow::showCustomExercise(int deckId)
+{
+    // Clear the grid layout, destroying the previous exercise cancels its requests
+    clearGridLayout();
 
-    QVBoxLayout *layout = new QVBoxLayout;
+    QWidget *exerciseWidget = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(exerciseWidget);
+
+    QPushButton *backButton = new QPushButton("Back", exerciseWidget);
+    backButton->setFixedWidth(40);
+    connect(backButton, &QPushButton::clicked, this, &MainWindow::showMainView);
+
+    QLabel *sentenceLabel = new QLabel("Generating custom task", exerciseWidget);
+    QLineEdit *inputEdit = new QLineEdit(exerciseWidget);
+    QPushButton *submitButton = new QPushButton("Submit", exerciseWidget);
+    QPushButton *nextButton = new QPushButton("Next Exercise", exerciseWidget);
+
+    layout->addWidget(backButton);
     layout->addWidget(sentenceLabel);
     layout->addWidget(inputEdit);
     layout->addWidget(submitButton);
     layout->addWidget(nextButton);
 
-    QWidget *centralWidget = new QWidget(this);
-    centralWidget->setLayout(layout);
-    setCentralWidget(centralWidget);
+    gridLayout->addWidget(exerciseWidget);
 
-    // Animate the dots
-    QTimer *timer = new QTimer(this);
+    // Animate the dots, only visible when the prefetch queue ran dry
+    QTimer *timer = new QTimer(exerciseWidget);
     dotCount = 0;
     connect(timer, &QTimer::timeout, this, [this, sentenceLabel]() mutable {
         dotCount = (dotCount + 1) % 4;  // Cycle through 0, 1, 2, 3
         QString dots(dotCount, '.');
         sentenceLabel->setText("Generating custom task" + dots);
     });
-    timer->start(500);  // Update every 500 milliseconds
 
-    promptOllama(frontSide, backSide, sentenceLabel, [this,frontSide,deckId, nextButton, sentenceLabel, inputEdit, submitButton, layout, timer]() {
+    // Draws a few cards at a time on the database thread and keeps exercises generated ahead of the user
+    connect(exercisePrefetcher, &ExercisePrefetcher::noCards, sentenceLabel, [deckId, sentenceLabel, timer](int emptyDeckId) {
+        if (emptyDeckId == deckId) {
+            qDebug() << "No flashcards found for deck ID:" << deckId;
+            timer->stop();
+            sentenceLabel->setText("This deck has no flashcards yet.");
+        }
+    });
+    exercisePrefetcher->start(deckId);
+    bool ready = exercisePrefetcher->requestExercise(exerciseWidget, [this, deckId, nextButton, sentenceLabel, inputEdit, submitButton, timer](const Exercise &exercise) {
         // Stop the animation timer
         timer->stop();
-        delete timer;
 
-        // Update layout with the response
-        QString responseText = sentenceLabel->text();
-        sentenceLabel->setText(responseText);
+        sentenceLabel->setText(exercise.sentence);
+        const QString frontSide = exercise.frontSide;
 
         // Connect the submit button to the slot for checking the answer
         connect(submitButton, &QPushButton::clicked, this, [=]() {
@@ -579,88 +1179,133 @@ void MainWindow::showCustomExercise(int deckId)
         });
         // Connect the next button to start a new custom exercise
         connect(nextButton, &QPushButton::clicked, this, [=]() { showCustomExercise(deckId); });
+    }, [sentenceLabel, timer](const QString &partial) {
+        // Render the sentence while it is still being generated
+        timer->stop();
+        sentenceLabel->setText(partial);
     });
+    if (!ready) {
+        timer->start(500);  // Update every 500 milliseconds
+    }
 }
 
+QSharedPointer<SimilarityIndex> MainWindow::similarityIndex(const QSharedPointer<CardStore> &cards)
+{
+    const int deckId = cards->deckId();
+    QSharedPointer<SimilarityIndex> &index = similarityIndexes[deckId];
+    if (!index) {
+        index = QSharedPointer<SimilarityIndex>::create(deckId);
+        staleSimilarityIndexes.insert(deckId);
+    }
+    // Notifications keep the index current card by card, the whole deck is only read for changes they did not name
+    if (staleSimilarityIndexes.remove(deckId)) {
+        QElapsedTimer clock;
+        clock.start();
+        index->update(*cards);
+        qDebug() << "Similarity index of deck" << deckId << "updated to" << index->size() << "cards in" << clock.elapsed() << "ms";
+    }
+    return index;
+}
 
-bool MainWindow::isServerRunning()
+void MainWindow::showMultipleChoice(int deckId)
 {
-    // Step 1: Check if port 8000 is in use
-    QProcess process;
-    process.start("sh", QStringList() << "-c" << "lsof -i :8000 | grep LISTEN");
-    process.waitForFinished();
-    QString output = process.readAllStandardOutput().trimmed();
+    clearGridLayout();
+    const int generation = gridGeneration;
+    const int choiceCount = qMax(2, QSettings("Language_app_qt", "Language_app_qt").value("exercises/choices", 4).toInt());
 
-    if (output.isEmpty()) {
-        // No process is listening on port 8000
-        return false;
-    }
+    QWidget *exerciseWidget = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(exerciseWidget);
 
-    // Step 2: Check if the server is responding
-    QNetworkAccessManager manager;
-    QNetworkRequest request(QUrl("http://localhost:8000/prompt/"));
-    QNetworkReply *reply = manager.get(request);
+    QPushButton *backButton = new QPushButton("Back", exerciseWidget);
+    backButton->setFixedWidth(40);
+    connect(backButton, &QPushButton::clicked, this, &MainWindow::showMainView);
 
-    QEventLoop loop;
-    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    loop.exec();
+    QLabel *questionLabel = new QLabel("Loading cards...", exerciseWidget);
+    questionLabel->setWordWrap(true);
+    QVBoxLayout *choicesLayout = new QVBoxLayout();
+    QPushButton *nextButton = new QPushButton("Next Exercise", exerciseWidget);
+    connect(nextButton, &QPushButton::clicked, this, [this, deckId]() { showMultipleChoice(deckId); });
 
-    bool serverIsRunning = reply->error() == QNetworkReply::NoError;
-    reply->deleteLater();
+    layout->addWidget(backButton);
+    layout->addWidget(questionLabel);
+    layout->addLayout(choicesLayout);
+    layout->addWidget(nextButton);
+    gridLayout->addWidget(exerciseWidget);
 
-    return serverIsRunning;
+    fetchCardStore(deckId, [=](QSharedPointer<CardStore> cards) {
+        if (generation != gridGeneration) {
+            return;
+        }
+        if (!cards || cards->size() < 2) {
+            questionLabel->setText("Multiple choice needs at least two cards in the deck.");
+            return;
+        }
+        QSharedPointer<SimilarityIndex> index = similarityIndex(cards);
+        const int answer = int(QRandomGenerator::global()->bounded(cards->size()));
+        const int cardId = cards->cardId(answer);
+        const QString frontSide = cards->frontSide(answer);
+
+        // The wrong choices are the fronts that look most like the answer, cards with the same front don't count
+        QStringList choices;
+        choices << frontSide;
+        QSet<QString> used;
+        used.insert(CardImporter::normalizedKey(frontSide));
+        for (const auto &neighbour : index->nearest(cardId, choiceCount * 3)) {
+            if (choices.size() == choiceCount) {
+                break;
+            }
+            const int row = cards->indexOf(neighbour.first);
+            if (row < 0) {
+                continue;
+            }
+            const QString other = cards->frontSide(row);
+            const QString key = CardImporter::normalizedKey(other);
+            if (!used.contains(key)) {
+                used.insert(key);
+                choices << other;
+            }
+        }
+        std::shuffle(choices.begin(), choices.end(), *QRandomGenerator::global());
+
+        asyncDb->fetchBackSide(cardId, questionLabel, [=](const QString &backSide) {
+            questionLabel->setText(QString("Which word means \"%1\"?").arg(backSide));
+            for (const QString &choice : choices) {
+                QPushButton *choiceButton = new QPushButton(choice, exerciseWidget);
+                choicesLayout->addWidget(choiceButton);
+                connect(choiceButton, &QPushButton::clicked, this, [=]() {
+                    if (choice == frontSide) {
+                        QMessageBox::information(this, "Correct!", "Well done, that's the right word!");
+                    } else {
+                        QMessageBox::warning(this, "Incorrect", QString("Oops! The right word is \"%1\".").arg(frontSide));
+                    }
+                });
+            }
+        });
+    });
 }
 
-
 void MainWindow::runServer()
 {
-    QProcess *serverProcess = new QProcess(this);
-
-    // Get the user's home directory
-    QString homeDir = QDir::homePath();
-    // Construct the full path to server.py
-    QString scriptPath = QDir(homeDir).filePath("Language_app_qt/server.py");
-    QString pythonExecutable = "/usr/bin/python3"; // Adjust this path to your Python executable
-
-    serverProcess->start(pythonExecutable, QStringList() << scriptPath);
-
-    if (!serverProcess->waitForStarted()) {
-        qDebug() << "Failed to start server.py";
-        qDebug() << serverProcess->errorString(); // Log process error
-    } else {
-        qDebug() << "server.py started successfully";
-        connect(serverProcess, &QProcess::readyReadStandardOutput, this, [=]() {
-            qDebug() << serverProcess->readAllStandardOutput();
-        });
-        connect(serverProcess, &QProcess::readyReadStandardError, this, [=]() {
-            qDebug() << serverProcess->readAllStandardError();
-        });
+    QSettings settings("Language_app_qt", "Language_app_qt");
+    QString scriptPath = settings.value("server/script", ServerSupervisor::findScript()).toString();
+    QString pythonExecutable = settings.value("server/python", "python3").toString();
+    if (scriptPath.isEmpty()) {
+        qDebug() << "Failed to start server.py: script not found, set server/script";
+        return;
     }
+
+    // Requests queue up in the client until the supervisor reports the server as ready
+    serverSupervisor = new ServerSupervisor(pythonExecutable, scriptPath, this);
+    connect(serverSupervisor, &ServerSupervisor::ready, this, [this](const QUrl &baseUrl) {
+        llmClient->setBackends(QList<QUrl>() << baseUrl);
+        markStartupPhase("server ready");
+    });
+    serverSupervisor->start();
 }
 
 void MainWindow::shutDownServer()
 {
-    QProcess findProcess;
-    findProcess.start("sh", QStringList() << "-c" << "lsof -ti :8000");
-    findProcess.waitForFinished();
-    QString pid = findProcess.readAllStandardOutput().trimmed();
-    if (!pid.isEmpty())
-    {
-        QProcess killProcess;
-        killProcess.start("sh", QStringList() << "-c" << QString("kill -9 %1").arg(pid));
-        killProcess.waitForFinished(); qDebug() << "Process on port 8000 killed successfully";
-    }
-    else
-    {
-        qDebug() << "No process found on port 8000";
+    if (serverSupervisor) {
+        serverSupervisor->stop();
     }
 }
-
-
-
-
-
-
-
-
-
@@ -5,10 +5,26 @@
 #include <QLabel>
 #include <QGridLayout>
 #include <QComboBox>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QPointer>
 #include "DBManager.h"
-#include "ClickableLabel.h"
+#include "AsyncDBManager.h"
+#include "DeckModel.h"
+#include "DeckDelegate.h"
+#include "CardStore.h"
+#include "ReviewScheduler.h"
+#include "SyncEngine.h"
+#include "CardSearch.h"
+#include "SimilarityIndex.h"
+#include "ExercisePrefetcher.h"
+#include "LLMClient.h"
+#include "ServerSupervisor.h"
 #include <QEventLoop>
 #include <QProcess>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QSet>
 
 class MainWindow : public QMainWindow
 {
@@ -20,6 +36,9 @@ public:
 signals:
     void responseReady();
 
+protected:
+    bool event(QEvent *event) override;
+
 private slots:
     void addDeck();
     void removeDeck();
@@ -28,24 +47,76 @@ private:
     int dotCount = 0;
     void clearGridLayout();
     void setupMainLayout();
-    void initializeDeckTable();
-    void initializeFlashcardsTable();
-    void showOptions();
+    void startDatabase();
+    void onDatabaseReady(bool ok, const QVector<QPair<int, QString>> &decks, const QVector<QPair<QString, qint64>> &phases);
+    void markStartupPhase(const QString &phase, qint64 elapsedMs = -1);
+    void showOptions(int deckId);
     void addFlashcard(int deckId);
+    void importFlashcards(int deckId);
+    // Every deck if deckIds is empty
+    void exportDecks(const QVector<int> &deckIds);
     void showFlashcards(int deckId);
+    // The deck's cards, loaded on the worker on first use and then shared by both views
+    void fetchCardStore(int deckId, std::function<void(QSharedPointer<CardStore> cards)> onReady);
+    void dropCardStore(int deckId);
+    // Every deck's cards, after changes the notifications do not say which decks they touched
+    void dropAllCardStores();
+    void addDeckWidget(int deckId, const QString &deckName);
+    void removeDeckWidget(int deckId);
     void showCustomExercise(int deckId);
-    void promptOllama(const QString &frontSide, const QString &backSide, QLabel *sentenceLabel, std::function<void()> onResponse);
+    // Picks the back side's word among look-alike fronts of the same deck, needs no LLM
+    void showMultipleChoice(int deckId);
+    // The deck's similarity index, built from cards on first use and then kept current by the card notifications
+    QSharedPointer<SimilarityIndex> similarityIndex(const QSharedPointer<CardStore> &cards);
+    void promptOllama(const QString &frontSide, const QString &backSide, LLMClient::Priority priority, QObject *context, std::function<void(const QString &response)> onResponse);
+    void promptOllamaStream(const QString &frontSide, const QString &backSide, QObject *context, std::function<void(const QString &partial)> onPartial, std::function<void(const QString &response)> onResponse);
+    void promptOllamaBatch(const QVector<Exercise> &cards, std::function<void(int cardId, const QString &response)> onResult, std::function<void()> onFinished);
+    void promptOllamaBatchNative(const QVector<Exercise> &cards, std::function<void(int cardId, const QString &response)> onResult, std::function<void()> onFinished);
     void runServer();
-    bool isServerRunning();
     void shutDownServer();
     DBManager dbManager;
-    void loadDecks();
-    QMap<int, ClickableLabel*> deckWidgets;
+    AsyncDBManager *asyncDb;
+    // Runs imports and exports, which can hold their connection for minutes
+    AsyncDBManager *transferDb;
+    ReviewScheduler *reviewScheduler;
+    int gridGeneration = 0;
+    QHash<int, QSharedPointer<CardStore>> cardStores;
+    // Bumped when a deck's cards change, a store loaded before that is not kept
+    QHash<int, int> cardStoreVersions;
+    QHash<int, QSharedPointer<SimilarityIndex>> similarityIndexes;
+    // Decks whose index missed changes, such as an import, and is brought up to date from the store on next use
+    QSet<int> staleSimilarityIndexes;
+    void onDatabaseNotification(const QString &channel, const QString &payload);
+    // Decks named by card notifications since the last flush, a bulk write drops each deck's cards once
+    QSet<int> changedDecks;
+    // Cards added or edited in decks with a similarity index, their fronts are read at the same flush
+    QHash<int, QSet<int>> changedCards;
+    QTimer *deckChangeTimer;
+    void dropChangedDecks();
+    // Decks and cards copied in from the server, everything loaded from the local database is read again
+    void onSynced(int pushed, int pulled);
+    SyncEngine *syncEngine = nullptr;
+    // Runs a search for what is in the search field, from the main view
+    void searchCards(const QString &text);
+    void appendSearchHits(const QVector<SearchHit> &hits, bool more, const QString &error);
+    CardSearch *cardSearch;
+    QLineEdit *searchField = nullptr;
+    QPointer<QListWidget> searchResults;
+    DeckModel *deckModel;
+    DeckDelegate *deckDelegate;
+    QPointer<QLabel> deckStatusLabel;
     QGridLayout *gridLayout;
     QComboBox *comboBox;
-    int rowCount;
-    int colCount;
     QString ollamaResponse;
+    LLMClient *llmClient;
+    ServerSupervisor *serverSupervisor;
+    QString llmModel;
+    bool nativeOllama;
+    ExercisePrefetcher *exercisePrefetcher;
     QEventLoop eventLoop;
+    QElapsedTimer startupClock;
+    bool profileStartup = false;
+    bool firstPaintDone = false;
+    bool databaseReady = false;
 };
 #endif // MAINWINDOW_H
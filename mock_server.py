@@ -0,0 +1,101 @@
+"""Stand-in for server.py and Ollama's /api/chat that answers without a model, with injectable latency.
+
+Run several of them on different ports and list them in the llm/backends
+setting to try out routing and hedging, e.g.
+
+    python3 mock_server.py --port 8001 --latency 0.2
+    python3 mock_server.py --port 8002 --latency 2 --jitter 3
+"""
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+import argparse
+import json
+import random
+import time
+
+args = None
+
+
+def make_sentence(front_side):
+    return f"This is an example sentence where _ replaces {len(front_side or '')} letters."
+
+
+class MockHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def do_GET(self):
+        self.send_json({"status": "ok"})
+
+    def do_POST(self):
+        length = int(self.headers.get('Content-Length', 0))
+        data = json.loads(self.rfile.read(length) or b'{}')
+
+        # Latency before the first byte, the part hedging is meant to hide
+        time.sleep(args.latency + random.uniform(0, args.jitter))
+        if random.random() < args.fail_rate:
+            self.send_error(500, "injected failure")
+            return
+
+        path = self.path.rstrip('/')
+        if path == '/prompt':
+            self.send_json({"response": make_sentence(data.get('front_side'))})
+        elif path == '/prompt/stream':
+            lines = [{"token": word + " "} for word in make_sentence(data.get('front_side')).split()]
+            self.send_lines(lines + [{"done": True}])
+        elif path == '/prompt/batch':
+            lines = [{"id": card.get('id'), "response": make_sentence(card.get('front_side'))} for card in data.get('cards', [])]
+            self.send_lines(lines + [{"done": True}])
+        elif path == '/api/chat':
+            self.send_chat(data)
+        else:
+            self.send_error(404)
+
+    def send_chat(self, data):
+        # Mimics Ollama: streams by default, "format": "json" answers numbered tasks as one object
+        prompt = data.get('messages', [{}])[-1].get('content', '')
+        model = data.get('model', 'llama3')
+        if data.get('format') == 'json':
+            tasks = [line.split('. ', 1) for line in prompt.splitlines() if line[:1].isdigit() and '. ' in line]
+            content = json.dumps({number: make_sentence(task) for number, task in tasks})
+        else:
+            content = make_sentence(prompt)
+        if data.get('stream', True):
+            lines = [{"model": model, "message": {"role": "assistant", "content": word + " "}, "done": False} for word in content.split()]
+            self.send_lines(lines + [{"model": model, "message": {"role": "assistant", "content": ""}, "done": True}])
+        else:
+            self.send_json({"model": model, "message": {"role": "assistant", "content": content}, "done": True})
+
+    def send_json(self, body):
+        payload = json.dumps(body).encode()
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def send_lines(self, lines):
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/x-ndjson')
+        self.send_header('Transfer-Encoding', 'chunked')
+        self.end_headers()
+        for line in lines:
+            chunk = (json.dumps(line) + "\n").encode()
+            self.wfile.write(b"%x\r\n%s\r\n" % (len(chunk), chunk))
+            self.wfile.flush()
+            time.sleep(args.token_delay)
+        self.wfile.write(b"0\r\n\r\n")
+
+    def log_message(self, format, *log_args):
+        if args.verbose:
+            super().log_message(format, *log_args)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', type=int, default=8000)
+    parser.add_argument('--latency', type=float, default=0.0, help='seconds before the first byte')
+    parser.add_argument('--jitter', type=float, default=0.0, help='extra random seconds added to the latency')
+    parser.add_argument('--token-delay', type=float, default=0.0, help='seconds between streamed lines')
+    parser.add_argument('--fail-rate', type=float, default=0.0, help='fraction of requests answered with HTTP 500')
+    parser.add_argument('--verbose', action='store_true')
+    args = parser.parse_args()
+    ThreadingHTTPServer(('127.0.0.1', args.port), MockHandler).serve_forever()
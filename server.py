@@ -1,22 +1,77 @@
-from flask import Flask, request, jsonify
+from flask import Flask, Response, request, jsonify, stream_with_context
+import argparse
 import json
 import ollama
 
 app = Flask(__name__)
 
+DEFAULT_MODEL = "llama3"
+DEFAULT_PROMPT_TEMPLATE = 'Please create a sentence using the word "{front_side}", but output it with this word replaces by "_" and output only this sentence'
+# Cards answered by a single model call in /prompt/batch
+BATCH_CHUNK_SIZE = 20
+
+@app.route('/health', methods=['GET'])
+def health():
+    # Readiness probe used by the application's server supervisor
+    return jsonify({"status": "ok"})
+
 @app.route('/prompt/', methods=['POST'])
 def get_request():
     # Parse the JSON request
     data = request.get_json()
     front_side = data.get('front_side')
     back_side = data.get('back_side')
-    response_message = prompt_olama(f'Please create a sentence using the word "{front_side}", but output it with this word replaces by "_" and output only this sentence')
+    # The client sends the model and template it uses as its exercise cache key
+    model = data.get('model', DEFAULT_MODEL)
+    prompt_template = data.get('prompt_template', DEFAULT_PROMPT_TEMPLATE)
+    response_message = prompt_olama(prompt_template.replace('{front_side}', front_side), model)
     response = {"response": response_message}
     return jsonify(response)
 
-def prompt_olama(prompt_text):
+@app.route('/prompt/stream', methods=['POST'])
+def get_request_stream():
+    # Same as /prompt/ but sends the sentence as NDJSON lines, one per token
+    data = request.get_json()
+    front_side = data.get('front_side')
+    model = data.get('model', DEFAULT_MODEL)
+    prompt_template = data.get('prompt_template', DEFAULT_PROMPT_TEMPLATE)
+    prompt_text = prompt_template.replace('{front_side}', front_side)
+
+    def generate():
+        try:
+            for chunk in prompt_olama_stream(prompt_text, model):
+                yield json.dumps({"token": chunk}) + "\n"
+            yield json.dumps({"done": True}) + "\n"
+        except Exception as error:
+            yield json.dumps({"error": str(error)}) + "\n"
+
+    return Response(stream_with_context(generate()), mimetype='application/x-ndjson')
+
+@app.route('/prompt/batch', methods=['POST'])
+def get_request_batch():
+    # Takes a list of cards and sends one NDJSON line {"id", "response"} per card as they are generated
+    data = request.get_json()
+    cards = data.get('cards', [])
+    model = data.get('model', DEFAULT_MODEL)
+    prompt_template = data.get('prompt_template', DEFAULT_PROMPT_TEMPLATE)
+
+    def generate():
+        for start in range(0, len(cards), BATCH_CHUNK_SIZE):
+            chunk = cards[start:start + BATCH_CHUNK_SIZE]
+            try:
+                sentences = prompt_olama_batch([prompt_template.replace('{front_side}', card['front_side']) for card in chunk], model)
+            except Exception as error:
+                yield json.dumps({"error": str(error)}) + "\n"
+                continue
+            for card, sentence in zip(chunk, sentences):
+                yield json.dumps({"id": card.get('id'), "response": sentence}) + "\n"
+        yield json.dumps({"done": True}) + "\n"
+
+    return Response(stream_with_context(generate()), mimetype='application/x-ndjson')
+
+def prompt_olama(prompt_text, model=DEFAULT_MODEL):
     response = ollama.chat(
-        model="llama3",
+        model=model,
         messages=[
             {
                 "role": "user",
@@ -26,5 +81,49 @@ def prompt_olama(prompt_text):
     )
     return response["message"]["content"]
 
+def prompt_olama_batch(prompts, model=DEFAULT_MODEL):
+    # Answers all prompts in one model call, falling back to single calls for anything the model skipped
+    numbered = "\n".join(f"{index + 1}. {prompt}" for index, prompt in enumerate(prompts))
+    response = ollama.chat(
+        model=model,
+        messages=[
+            {
+                "role": "user",
+                "content": "Answer each numbered task independently. Reply only with a JSON object whose keys are "
+                           "the task numbers and whose values are the answers.\n" + numbered,
+            },
+        ],
+        format="json",
+    )
+    try:
+        answers = json.loads(response["message"]["content"])
+    except ValueError:
+        answers = {}
+    sentences = []
+    for index, prompt in enumerate(prompts):
+        sentence = answers.get(str(index + 1)) if isinstance(answers, dict) else None
+        if not isinstance(sentence, str) or not sentence.strip():
+            sentence = prompt_olama(prompt, model)
+        sentences.append(sentence.strip())
+    return sentences
+
+def prompt_olama_stream(prompt_text, model=DEFAULT_MODEL):
+    stream = ollama.chat(
+        model=model,
+        messages=[
+            {
+                "role": "user",
+                "content": prompt_text,
+            },
+        ],
+        stream=True,
+    )
+    for chunk in stream:
+        yield chunk["message"]["content"]
+
 if __name__ == '__main__':
-    app.run(debug=True, host='127.0.0.1', port=8000)
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--port', type=int, default=8000)
+    args = parser.parse_args()
+    # No reloader: it forks a second process that would outlive the supervisor's SIGTERM
+    app.run(debug=True, use_reloader=False, host='127.0.0.1', port=args.port)